@@ -0,0 +1,1140 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <omp.h>
+
+#include <string>
+#include <vector>
+#include <iostream>
+#include <fstream>
+#include <algorithm>
+#include <gtx/rotate_vector.hpp>
+
+using namespace std;
+
+#include "triangle.hpp"
+#include "grid.hpp"
+#include "scene.hpp"
+#include "timer.hpp"
+#include "trajectoryReader.hpp"
+
+//****************************************************
+// Collision and broadphase benchmarks.
+// Usage: bench pairs [pile size] [frames to settle] [repetitions]
+//        bench broadphase [substeps]
+//        bench threads [max threads] [substeps] [pile size]
+//        bench integrate [pile size] [repetitions]
+//        bench trajectory file.traj [file.txt]
+//        bench scene [bodies]
+//        bench kernels [repetitions] [warmup] [scene ...]
+//        bench sleep [pile size] [frames to settle] [substeps]
+//****************************************************
+
+float stepTime = 0.0005f;
+
+void substep(Grid &gr) {
+    gr.substep(stepTime);
+}
+
+// Bodies and statics as Triangles in slot order, for the old path
+std::vector<Triangle> slotTris;
+std::vector<Triangle> slotStatics;
+
+void copyToSlots(BodyStore &store, std::vector<Triangle> &out) {
+    out.resize(store.size());
+    for (unsigned int i = 0; i < store.size(); i++) {
+        store.load(i, out[i]);
+    }
+}
+
+// The old collision loop: copy both Triangles by value, collide them
+// and copy them back for every candidate pair
+void collideByCopy(Grid &gr) {
+    for (unsigned int p = 0; p < gr.pairs.size(); p++) {
+        BodyPair &pair = gr.pairs[p];
+        std::vector<Triangle> &other = pair.isStatic ? slotStatics : slotTris;
+        Triangle tr1 = slotTris.at(pair.a);
+        Triangle tr2 = other.at(pair.b);
+        if (tr1.collide(tr2)) {
+            other[pair.b] = tr2;
+        }
+        slotTris[pair.a] = tr1;
+    }
+}
+
+// The in place path used by Grid::rebalance
+void collideInPlace(Grid &gr) {
+    gr.narrowphase();
+    gr.applyContacts();
+}
+
+// The in place path warm started from the pair cache
+void collideCached(Grid &gr) {
+    gr.useCache = true;
+    gr.narrowphase();
+    gr.applyContacts();
+    gr.useCache = false;
+}
+
+// Runs both paths once from the same state and counts the bodies whose
+// velocities end more than 1e-3 apart. Both collide the same pairs in
+// the same order, but the store keeps midpoints instead of averaging
+// vertices and sums contacts after the narrowphase, so inputs and sums
+// round differently. The SAT axis, clip point and spin direction are
+// picked by comparisons, and a tie decided the other way changes a
+// whole contact; worst is the largest such change.
+int comparePaths(Grid &gr, float &worst) {
+    BodyStore &store = gr.bodies;
+    std::vector<float> velX = store.velX;
+    std::vector<float> velY = store.velY;
+    std::vector<float> angVel = store.angVel;
+    copyToSlots(store, slotTris);
+    copyToSlots(gr.statics, slotStatics);
+    collideByCopy(gr);
+    collideInPlace(gr);
+    int differ = 0;
+    worst = 0.0f;
+    for (unsigned int i = 0; i < store.size(); i++) {
+        Triangle &t = slotTris[i];
+        float d = std::max(fabs(t.velocity[0] - store.velX[i]),
+                           fabs(t.velocity[1] - store.velY[i]));
+        d = std::max(d, fabs(t.rotationalVelocity - store.angVel[i]));
+        differ += d > 1e-3f;
+        worst = std::max(worst, d);
+    }
+    store.velX = velX;
+    store.velY = velY;
+    store.angVel = angVel;
+    return differ;
+}
+
+double timePairs(Grid &gr, void (*run)(Grid &), int reps) {
+    // warm up
+    run(gr);
+    double beg = getTime();
+    for (int r = 0; r < reps; r++) {
+        run(gr);
+    }
+    double end = getTime();
+    return (end - beg) / reps / gr.pairs.size() * 1e9;
+}
+
+// Substeps a second of gr with the pair cache on or off
+double timeSubsteps(Grid &gr, bool cached, int substeps) {
+    gr.useCache = cached;
+    double beg = getTime();
+    for (int i = 0; i < substeps; i++) {
+        substep(gr);
+    }
+    double end = getTime();
+    gr.useCache = false;
+    return (end - beg) / substeps * 1000;
+}
+
+// Per pair cost of the copying collision loop against the in place one
+// on a pile, with terrain statics under it if terrain is not 0
+int pairsScene(const char *name, int count, int terrain, int settle,
+               int reps) {
+    std::vector<Triangle> tris = std::vector<Triangle>();
+    std::vector<Triangle> statics = std::vector<Triangle>();
+    float width = buildPileScene(tris, statics, count);
+    addTerrain(statics, terrain, 5.0f, 400.0f, 15.0f);
+    Grid gr(tris, statics, width * 2.0f);
+
+    // Let the pile settle a little so contacts are realistic
+    for (int f = 0; f < settle; f++) {
+        for (int i = 0; i < 10; i++) {
+            substep(gr);
+        }
+    }
+    gr.findPairs();
+    if (gr.pairs.size() == 0) {
+        std::cout << "No candidate pairs after " << settle << " frames\n";
+        return 1;
+    }
+    unsigned int staticPairs = 0;
+    for (unsigned int p = 0; p < gr.pairs.size(); p++) {
+        staticPairs += gr.pairs[p].isStatic;
+    }
+
+    float worst;
+    int differ = comparePaths(gr, worst);
+    copyToSlots(gr.bodies, slotTris);
+    copyToSlots(gr.statics, slotStatics);
+    double copyNs = timePairs(gr, collideByCopy, reps);
+    double inPlaceNs = timePairs(gr, collideInPlace, reps);
+    double cachedNs = timePairs(gr, collideCached, reps);
+    unsigned int hits = 0;
+    for (unsigned int p = 0; p < gr.contacts.size(); p++) {
+        hits += gr.contacts[p].hit;
+    }
+
+    std::cout << name << "\n";
+    std::cout << "Bodies: " << gr.bodies.size()
+              << " Statics: " << gr.statics.size()
+              << " Candidate pairs: " << gr.pairs.size()
+              << " (" << staticPairs << " static)"
+              << " Contacts: " << hits << "\n";
+    std::cout << "Copy per pair:     " << copyNs << " ns\n";
+    std::cout << "In place per pair: " << inPlaceNs << " ns, "
+              << SIMD_LANES << " SAT lanes\n";
+    std::cout << "Speedup: " << copyNs / inPlaceNs << "x\n";
+    std::cout << "Bodies the paths disagree on: " << differ
+              << ", largest velocity difference " << worst << "\n";
+    std::cout << "Cached per pair:   " << cachedNs << " ns, "
+              << 100.0 * gr.cache.earlyExits / gr.cache.lookups
+              << "% early exits\n";
+    double plainMs = timeSubsteps(gr, false, reps);
+    double cachedMs = timeSubsteps(gr, true, reps);
+    std::cout << "Substep: " << plainMs << " ms, " << cachedMs
+              << " ms with the cache\n\n";
+    return 0;
+}
+
+// The pile alone, then on terrain so most pairs are against statics
+int benchPairs(int argc, char *argv[]) {
+    int count = 6400;
+    int settle = 20;
+    int reps = 20;
+    if (argc > 0) {
+        count = atoi(argv[0]);
+    }
+    if (argc > 1) {
+        settle = atoi(argv[1]);
+    }
+    if (argc > 2) {
+        reps = atoi(argv[2]);
+    }
+    if (pairsScene("pile", count, 0, settle, reps) != 0) {
+        return 1;
+    }
+    return pairsScene("pile on terrain", count, 2000, settle, reps);
+}
+
+// Runs one scene with one broadphase and prints a row of results
+const char *broadphaseName(BroadphaseType type) {
+    switch (type) {
+    case CELL_BROADPHASE:
+        return "cell";
+    case TREE_BROADPHASE:
+        return "tree";
+    case SWEEP_BROADPHASE:
+        return "sweep";
+    default:
+        return "strip";
+    }
+}
+
+// Returns the pairs per substep found with terrain statics, the base
+// being static 0
+unsigned long long benchScene(const char *name, const std::string &scene,
+                              int count, int terrain, BroadphaseType type,
+                              int substeps) {
+    std::vector<Triangle> tris = std::vector<Triangle>();
+    std::vector<Triangle> statics = std::vector<Triangle>();
+    float width;
+    if (scene == "pile") {
+        width = buildPileScene(tris, statics, count);
+    } else if (scene == "mixed") {
+        width = buildMixedScene(tris, statics, count);
+    } else {
+        width = buildDefaultScene(tris, statics, count);
+    }
+    addTerrain(statics, terrain, 5.0f, 400.0f, 15.0f);
+    Grid gr(tris, statics, width * 2.0f, type);
+    // warm up
+    for (int i = 0; i < 10; i++) {
+        substep(gr);
+    }
+
+    double stepTotal = 0.0;
+    double pairTotal = 0.0;
+    unsigned long long tests = 0;
+    unsigned long long pairs = 0;
+    unsigned long long terrainPairs = 0;
+    for (int i = 0; i < substeps; i++) {
+        // A substep split up so the broadphase sees this step's motion
+        double beg = getTime();
+        gr.stepAll(stepTime);
+        gr.initialSort();
+        double mid = getTime();
+        gr.findPairs();
+        double end = getTime();
+        gr.narrowphase();
+        gr.applyContacts();
+        stepTotal += getTime() - beg;
+        pairTotal += end - mid;
+        tests += gr.pairTests;
+        pairs += gr.pairs.size();
+        for (unsigned int p = 0; p < gr.pairs.size(); p++) {
+            terrainPairs += gr.pairs[p].isStatic && gr.pairs[p].b != 0;
+        }
+    }
+    printf("%-12s %-6s %8u %12llu %10llu %10llu %10.3f %10.3f\n", name,
+           broadphaseName(type), gr.bodies.size(),
+           tests / substeps, pairs / substeps, terrainPairs / substeps,
+           stepTotal / substeps * 1000, pairTotal / substeps * 1000);
+    return terrainPairs / substeps;
+}
+
+// Candidate counts and timings of each broadphase on the same scenes
+int benchBroadphase(int argc, char *argv[]) {
+    int substeps = 20;
+    if (argc > 0) {
+        substeps = atoi(argv[0]);
+    }
+    printf("%-12s %-6s %8s %12s %10s %10s %10s %10s\n", "scene", "broad",
+           "bodies", "aabb tests", "pairs", "terrain", "ms/substep",
+           "ms/pairs");
+    BroadphaseType types[4] = {
+        STRIP_BROADPHASE, CELL_BROADPHASE, TREE_BROADPHASE, SWEEP_BROADPHASE
+    };
+    for (int t = 0; t < 4; t++) {
+        benchScene("grid80", "grid", 80, 0, types[t], substeps);
+    }
+    for (int t = 0; t < 4; t++) {
+        benchScene("pile6400", "pile", 6400, 0, types[t], substeps);
+    }
+    for (int t = 0; t < 4; t++) {
+        benchScene("pile50000", "pile", 50000, 0, types[t], substeps);
+    }
+    // Many statics of very different sizes poking up into the pile
+    for (int t = 0; t < 4; t++) {
+        if (benchScene("terrain6400", "pile", 6400, 2000, types[t],
+                       substeps) == 0) {
+            fprintf(stderr, "terrain6400 found no terrain pairs\n");
+            return 1;
+        }
+    }
+    // Moving bodies wider than triSize. The strip and cell broadphases
+    // assume none are, so they miss some of the pairs the others find.
+    for (int t = 0; t < 4; t++) {
+        benchScene("mixed80", "mixed", 80, 0, types[t], substeps);
+    }
+    return 0;
+}
+
+// Collision phase timings of a pile from 1 thread up to max
+int benchThreads(int argc, char *argv[]) {
+    int maxThreads = omp_get_num_procs();
+    int substeps = 50;
+    int count = 50000;
+    if (argc > 0) {
+        maxThreads = atoi(argv[0]);
+    }
+    if (argc > 1) {
+        substeps = atoi(argv[1]);
+    }
+    if (argc > 2) {
+        count = atoi(argv[2]);
+    }
+
+    printf("%7s %9s %9s %9s %9s %9s %8s %10s\n", "threads", "step ms",
+           "pairs ms", "narrow ms", "apply ms", "collide", "speedup",
+           "state");
+    double baseline = 0.0;
+    for (int threads = 1; threads <= maxThreads; threads *= 2) {
+        std::vector<Triangle> tris = std::vector<Triangle>();
+        std::vector<Triangle> statics = std::vector<Triangle>();
+        float width = buildPileScene(tris, statics, count);
+        Grid gr(tris, statics, width * 2.0f);
+        gr.numThreads = threads;
+        for (int i = 0; i < 10; i++) {
+            substep(gr);
+        }
+
+        double step = 0.0;
+        double find = 0.0;
+        double narrow = 0.0;
+        double apply = 0.0;
+        for (int i = 0; i < substeps; i++) {
+            double t0 = getTime();
+            gr.stepAll(stepTime);
+            gr.initialSort();
+            double t1 = getTime();
+            gr.findPairs();
+            double t2 = getTime();
+            gr.narrowphase();
+            double t3 = getTime();
+            gr.applyContacts();
+            double t4 = getTime();
+            step += t1 - t0;
+            find += t2 - t1;
+            narrow += t3 - t2;
+            apply += t4 - t3;
+        }
+        double scale = 1000.0 / substeps;
+        double collide = (find + narrow + apply) * scale;
+        if (threads == 1) {
+            baseline = collide;
+        }
+        printf("%7d %9.3f %9.3f %9.3f %9.3f %9.3f %7.2fx %10x\n", threads,
+               step * scale, find * scale, narrow * scale, apply * scale,
+               collide, baseline / collide, gr.bodies.stateHash());
+
+        // Also try the largest count if it is not a power of two
+        if (threads < maxThreads && threads * 2 > maxThreads) {
+            threads = maxThreads / 2;
+        }
+    }
+
+    // Whole substeps as a task graph on a worker pool
+    printf("\n%7s %9s %9s %9s %9s %9s %8s %10s\n", "pool", "step ms",
+           "pairs ms", "narrow ms", "apply ms", "substep", "speedup",
+           "state");
+    for (int threads = 1; threads <= maxThreads; threads *= 2) {
+        std::vector<Triangle> tris = std::vector<Triangle>();
+        std::vector<Triangle> statics = std::vector<Triangle>();
+        float width = buildPileScene(tris, statics, count);
+        Grid gr(tris, statics, width * 2.0f);
+        TaskPool pool(threads);
+        gr.pool = &pool;
+        for (int i = 0; i < 10; i++) {
+            substep(gr);
+        }
+        gr.stepGraph.resetStats();
+
+        double beg = getTime();
+        for (int i = 0; i < substeps; i++) {
+            substep(gr);
+        }
+        double total = (getTime() - beg) * 1000.0 / substeps;
+        if (threads == 1) {
+            baseline = total;
+        }
+        // Wall time of the tasks making up each stage
+        double stage[4] = { 0.0, 0.0, 0.0, 0.0 };
+        for (unsigned int t = 0; t < gr.stepGraph.tasks.size(); t++) {
+            Task &task = gr.stepGraph.tasks[t];
+            std::string name = task.name;
+            int at = 0;
+            if (name == "pairs") {
+                at = 1;
+            } else if (name == "gather" || name == "narrow") {
+                at = 2;
+            } else if (name == "apply") {
+                at = 3;
+            }
+            stage[at] += task.wall * 1000.0 / substeps;
+        }
+        printf("%7d %9.3f %9.3f %9.3f %9.3f %9.3f %7.2fx %10x\n", threads,
+               stage[0], stage[1], stage[2], stage[3], total,
+               baseline / total, gr.bodies.stateHash());
+        gr.pool = NULL;
+
+        if (threads < maxThreads && threads * 2 > maxThreads) {
+            threads = maxThreads / 2;
+        }
+    }
+    return 0;
+}
+
+// Per body edge normals as the old integrator kept them
+std::vector<glm::vec2> oldNorms;
+
+// The old integrator: world vertices turned by glm::rotate every step,
+// then the centroid, bounds and normals worked out from them again
+void stepByRotate(BodyStore &bodies, float delta) {
+    oldNorms.resize(bodies.size() * 3);
+    for (unsigned int slot = 0; slot < bodies.size(); slot++) {
+        if (bodies.invMass[slot] == 0.0f) {
+            continue;
+        }
+        glm::vec2 mid(bodies.midX[slot], bodies.midY[slot]);
+        glm::vec2 vel(bodies.velX[slot], bodies.velY[slot]);
+        float rotation = bodies.angVel[slot] * delta;
+        glm::vec2 pts[3];
+        for (int i = 0 ; i < 3; i++) {
+            glm::vec2 rad = glm::vec2(bodies.vertX[i][slot],
+                                      bodies.vertY[i][slot]) - mid;
+            pts[i] = mid + glm::rotate(rad, rotation) + vel * delta;
+            bodies.vertX[i][slot] = pts[i][0];
+            bodies.vertY[i][slot] = pts[i][1];
+        }
+        vel += glm::vec2(.0f, -10.0f) * delta;
+        bodies.angVel[slot] *= 0.9995f;
+        vel *= 0.9995f;
+        bodies.velX[slot] = vel[0];
+        bodies.velY[slot] = vel[1];
+        mid = (pts[0] + pts[1] + pts[2]) / 3.0f;
+        bodies.midX[slot] = mid[0];
+        bodies.midY[slot] = mid[1];
+        bodies.updateBounds(slot);
+        if (rotation != 0.0f) {
+            edgeNormals(pts, mid, &oldNorms[slot * 3]);
+        }
+    }
+}
+
+void stepBatched(BodyStore &bodies, float delta) {
+    bodies.stepAll(delta);
+}
+
+// Largest change of an edge length from the body's shape, relative to it
+float vertexDrift(BodyStore &bodies) {
+    float worst = 0.0f;
+    for (unsigned int slot = 0; slot < bodies.size(); slot++) {
+        unsigned int s = bodies.shape[slot];
+        for (int i = 0; i < 3; i++) {
+            int j = (i + 1) % 3;
+            float want = glm::length(glm::vec2(
+                bodies.shapes.vertX[j][s] - bodies.shapes.vertX[i][s],
+                bodies.shapes.vertY[j][s] - bodies.shapes.vertY[i][s]));
+            float got = glm::length(glm::vec2(
+                bodies.vertX[j][slot] - bodies.vertX[i][slot],
+                bodies.vertY[j][slot] - bodies.vertY[i][slot]));
+            worst = std::max(worst, std::fabs(got - want) / want);
+        }
+    }
+    return worst;
+}
+
+double timeIntegrate(BodyStore bodies, void (*run)(BodyStore &, float),
+                     int reps, float &drift) {
+    double beg = getTime();
+    for (int r = 0; r < reps; r++) {
+        run(bodies, stepTime);
+    }
+    double end = getTime();
+    drift = vertexDrift(bodies);
+    return (end - beg) / reps / bodies.size() * 1e9;
+}
+
+// Per body cost and vertex drift of the old integrator against the
+// batched one, from the same spinning start
+int benchIntegrate(int argc, char *argv[]) {
+    int count = 6400;
+    int reps = 200;
+    if (argc > 0) {
+        count = atoi(argv[0]);
+    }
+    if (argc > 1) {
+        reps = atoi(argv[1]);
+    }
+
+    std::vector<Triangle> tris = std::vector<Triangle>();
+    std::vector<Triangle> statics = std::vector<Triangle>();
+    float width = buildPileScene(tris, statics, count);
+    srand(3);
+    for (unsigned int i = 0; i < tris.size(); i++) {
+        tris[i].rotationalVelocity = (rand() % 2001 - 1000) / 10.0f;
+    }
+    Grid gr(tris, statics, width * 2.0f);
+
+    float oldDrift, newDrift;
+    double oldNs = timeIntegrate(gr.bodies, stepByRotate, reps, oldDrift);
+    double newNs = timeIntegrate(gr.bodies, stepBatched, reps, newDrift);
+    std::cout << "Bodies: " << gr.bodies.size() << " Shapes: "
+              << gr.bodies.numShapes() << " Steps: " << reps
+              << " Lanes: " << SIMD_LANES << "\n";
+    std::cout << "glm::rotate per body: " << oldNs << " ns, edge drift "
+              << oldDrift << "\n";
+    std::cout << "Batched per body:     " << newNs << " ns, edge drift "
+              << newDrift << "\n";
+    std::cout << "Speedup: " << oldNs / newNs << "x\n";
+    return 0;
+}
+
+// Mean centroid height of a frame, standing in for a metric pass
+double meanHeight(const TrajView &frame) {
+    double sum = 0.0;
+    for (unsigned int id = 0; id < frame.count; id++) {
+        sum += frame.midY[id];
+    }
+    return frame.count > 0 ? sum / frame.count : 0.0;
+}
+
+// Mean centroid height of the last line of a printTimestep text dump,
+// parsing every line before it the way the old tools had to
+double textLastHeight(const char *file, unsigned int &lines) {
+    ifstream in(file);
+    std::string line, lastLine;
+    lines = 0;
+    double mean = 0.0;
+    while (std::getline(in, line)) {
+        lines++;
+        // Split every body as a reader of the text has to
+        double sum = 0.0;
+        unsigned int bodies = 0;
+        const char *p = strchr(line.c_str(), '\t');
+        while (p != NULL) {
+            char *end;
+            float y = 0.0f;
+            p++;
+            for (int i = 0; i < 3; i++) {
+                strtod(p, &end);
+                y += (float)strtod(end + 1, &end);
+                p = end;
+            }
+            sum += y / 3.0f;
+            bodies++;
+            p = strchr(p, '\t');
+        }
+        mean = bodies > 0 ? sum / bodies : 0.0;
+    }
+    return mean;
+}
+
+// Opening a recording, reaching its last frame, and a metric over every
+// frame in random order, against parsing the same run as text
+int benchTrajectory(int argc, char *argv[]) {
+    if (argc < 1) {
+        fprintf(stderr, "bench trajectory needs a recorded file\n");
+        return 1;
+    }
+    TrajectoryReader reader;
+    double beg = getTime();
+    if (!reader.open(argv[0])) {
+        fprintf(stderr, "%s is not a trajectory\n", argv[0]);
+        return 1;
+    }
+    double openTime = getTime() - beg;
+    unsigned int count = reader.frameCount();
+    if (count == 0) {
+        fprintf(stderr, "%s has no frames\n", argv[0]);
+        return 1;
+    }
+
+    TrajView frame;
+    beg = getTime();
+    reader.view(count - 1, frame);
+    double lastMean = meanHeight(frame);
+    double lastTime = getTime() - beg;
+
+    std::vector<unsigned int> order(count);
+    for (unsigned int i = 0; i < count; i++) {
+        order[i] = i;
+    }
+    srand(5);
+    std::random_shuffle(order.begin(), order.end());
+    double total = 0.0;
+    beg = getTime();
+    for (unsigned int i = 0; i < count; i++) {
+        reader.view(order[i], frame);
+        total += meanHeight(frame);
+    }
+    double sweepTime = getTime() - beg;
+
+    std::cout << "Bodies: " << reader.header().bodyCount << " Frames: "
+              << count << (reader.indexed() ? "" : " unindexed")
+              << (reader.header().encoding == TRAJ_QUANTIZED ?
+                  " quantized" : "") << "\n";
+    std::cout << "Open:                " << openTime * 1000 << " ms\n";
+    std::cout << "Last frame:          " << lastTime * 1000
+              << " ms, mean height " << lastMean << "\n";
+    std::cout << "All frames shuffled: " << sweepTime * 1000 << " ms, "
+              << sweepTime / count * 1e6 << " us per frame, checksum "
+              << total << "\n";
+
+    if (argc > 1) {
+        unsigned int lines;
+        beg = getTime();
+        double textMean = textLastHeight(argv[1], lines);
+        double textTime = getTime() - beg;
+        std::cout << "Text to last frame:  " << textTime * 1000
+                  << " ms over " << lines << " lines, mean height "
+                  << textMean << "\n";
+    }
+    return 0;
+}
+
+// The scene loader as it was, getline, strtok and atof with no reserve.
+// Skips blank lines, where the original read past the end.
+bool loadSceneOld(const char *file, std::vector<Triangle> &tris) {
+    std::ifstream fin;
+    fin.open(file);
+    if (!fin.good())
+        return false;
+
+    while (!fin.eof())
+        {
+            char buf[512];
+            fin.getline(buf, 512);
+            char *tok = strtok(buf, " ");
+            if (tok == NULL) {
+                continue;
+            }
+            float x = ::atof(tok);
+            float y = ::atof(strtok(0, " "));
+            glm::vec2 center = glm::vec2(x, y);
+            float width = ::atof(strtok(0, " "));
+            Triangle t = Triangle(center, width);
+            t.invMass = 1.0f;
+            tris.push_back(t);
+        }
+    return true;
+}
+
+bool sameBodies(std::vector<Triangle> &a, std::vector<Triangle> &b) {
+    if (a.size() != b.size()) {
+        return false;
+    }
+    for (unsigned int i = 0; i < a.size(); i++) {
+        for (int v = 0; v < 3; v++) {
+            if (a[i].verts[v] != b[i].verts[v]) {
+                return false;
+            }
+        }
+        if (a[i].invMass != b[i].invMass ||
+            a[i].velocity != b[i].velocity ||
+            a[i].rotationalVelocity != b[i].rotationalVelocity) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Load times of a generated scene through the old parser, the mapped
+// text parser and the binary format, then filling a store from it
+int benchScene(int argc, char *argv[]) {
+    int count = 1000000;
+    if (argc > 0) {
+        count = atoi(argv[0]);
+    }
+    const char *textFile = "bench_scene.txt";
+    const char *binaryFile = "bench_scene.scn";
+    FILE *out = fopen(textFile, "w");
+    if (out == NULL) {
+        fprintf(stderr, "Failed to create %s\n", textFile);
+        return 1;
+    }
+    srand(8);
+    for (int i = 0; i < count; i++) {
+        float x = -5000.0f + 10000.0f * rand() / RAND_MAX;
+        float y = -5000.0f + 10000.0f * rand() / RAND_MAX;
+        float width = 2.0f + (rand() % 4);
+        fprintf(out, "%.3f %.3f %g\n", x, y, width);
+    }
+    fclose(out);
+
+    std::vector<Triangle> oldTris, textTris, binaryTris;
+    double beg = getTime();
+    loadSceneOld(textFile, oldTris);
+    double oldTime = getTime() - beg;
+
+    beg = getTime();
+    bool textOk = loadSceneFile(textFile, textTris);
+    double textTime = getTime() - beg;
+
+    beg = getTime();
+    bool saved = saveSceneBinary(binaryFile, textTris);
+    double saveTime = getTime() - beg;
+
+    beg = getTime();
+    bool binaryOk = saved && loadSceneFile(binaryFile, binaryTris);
+    double binaryTime = getTime() - beg;
+
+    beg = getTime();
+    BodyStore store;
+    store.reserve(binaryTris.size());
+    for (unsigned int i = 0; i < binaryTris.size(); i++) {
+        store.add(binaryTris[i]);
+    }
+    store.refreshDirty();
+    double storeTime = getTime() - beg;
+
+    remove(textFile);
+    remove(binaryFile);
+
+    std::cout << "Bodies: " << count << "\n";
+    std::cout << "getline/strtok/atof: " << oldTime * 1000 << " ms\n";
+    std::cout << "Mapped text:         " << textTime * 1000 << " ms, "
+              << (textOk && sameBodies(oldTris, textTris) ? "same bodies"
+                  : "DIFFERENT bodies") << "\n";
+    std::cout << "Binary:              " << binaryTime * 1000 << " ms, "
+              << (binaryOk && sameBodies(textTris, binaryTris) ?
+                  "same bodies" : "DIFFERENT bodies")
+              << ", saved in " << saveTime * 1000 << " ms\n";
+    std::cout << "Filling the store:   " << storeTime * 1000 << " ms, "
+              << store.numShapes() << " shapes\n";
+    return 0;
+}
+
+// Spread of repeated timings of one kernel
+struct RunStats {
+    double min;
+    double median;
+    double mean;
+    double stddev;
+};
+
+RunStats runStats(std::vector<double> times) {
+    RunStats st;
+    std::sort(times.begin(), times.end());
+    unsigned int n = times.size();
+    st.min = times[0];
+    st.median = n % 2 ? times[n / 2] : (times[n / 2 - 1] + times[n / 2]) / 2;
+    st.mean = 0.0;
+    for (unsigned int i = 0; i < n; i++) {
+        st.mean += times[i];
+    }
+    st.mean /= n;
+    double var = 0.0;
+    for (unsigned int i = 0; i < n; i++) {
+        var += (times[i] - st.mean) * (times[i] - st.mean);
+    }
+    st.stddev = n > 1 ? sqrt(var / (n - 1)) : 0.0;
+    return st;
+}
+
+// One row of the kernel table. Times are per run; pairs is how many
+// pairs a run handles, or 0 for kernels timed per body.
+void printKernel(const char *scene, const char *kernel, unsigned int bodies,
+                 unsigned long long pairs, const std::vector<double> &times) {
+    RunStats st = runStats(times);
+    char pairText[32] = "-";
+    if (pairs > 0) {
+        sprintf(pairText, "%llu", pairs);
+    }
+    double ns = st.median / (pairs > 0 ? pairs : bodies) * 1e9;
+    printf("%-10s %-17s %8u %9s %9.2f %-4s %9.3f %9.3f %6.1f%% %10.4g\n",
+           scene, kernel, bodies, pairText, ns, pairs > 0 ? "pair" : "body",
+           st.median * 1000, st.min * 1000,
+           st.mean > 0.0 ? 100.0 * st.stddev / st.mean : 0.0,
+           bodies / st.median);
+}
+
+// Fixed seed scenes of benchKernels, in the order they run by default
+#define KERNEL_SCENES 5
+const char *kernelScenes[KERNEL_SCENES] = {
+    "grid80", "pile", "cloud", "grid50k", "grid500k"
+};
+
+// Settled pile of the kernel benchmarks, saved on first use so every
+// later run times the same bodies. It is kept in the temp directory and
+// named by a key of the settle parameters and of the pile's state after
+// PILE_PROBE_STEPS substeps, so a change to the scene, the physics or
+// the settling makes a new file instead of loading a stale pile.
+#define PILE_PROBE_STEPS 100
+// The pile counts as settled once no body is faster than this, checked
+// every PILE_SETTLE_CHECK substeps up to PILE_SETTLE_MAX
+#define PILE_SETTLE_SPEED 15.0f
+#define PILE_SETTLE_CHECK 500
+#define PILE_SETTLE_MAX 60000
+
+float maxBodySpeed(BodyStore &bodies) {
+    float fastest = 0.0f;
+    for (unsigned int i = 0; i < bodies.size(); i++) {
+        fastest = std::max(fastest, sqrtf(bodies.velX[i] * bodies.velX[i] +
+                                          bodies.velY[i] * bodies.velY[i]));
+    }
+    return fastest;
+}
+
+// Where bench keeps files it can rebuild, the system's temp directory
+std::string cacheDir(void) {
+    const char *vars[3] = { "TEMP", "TMP", "TMPDIR" };
+    for (int i = 0; i < 3; i++) {
+        const char *dir = getenv(vars[i]);
+        if (dir != NULL && dir[0] != '\0') {
+            return dir;
+        }
+    }
+#ifdef _WIN32
+    return ".";
+#else
+    return "/tmp";
+#endif
+}
+
+// File name for the settled pile, from the probed state hash and the
+// settle parameters
+std::string pileFixture(unsigned int count, unsigned int state) {
+    unsigned int params[5] = {
+        count, PILE_PROBE_STEPS, (unsigned int)(PILE_SETTLE_SPEED * 1000),
+        PILE_SETTLE_CHECK, PILE_SETTLE_MAX
+    };
+    unsigned int key = state;
+    const unsigned char *bytes = (const unsigned char *)params;
+    for (unsigned int i = 0; i < sizeof(params); i++) {
+        key = (key ^ bytes[i]) * 16777619u;
+    }
+    char name[64];
+    sprintf(name, "/pile%u-%08x.scene", count, key);
+    return cacheDir() + name;
+}
+
+// Replaces the freshly built pile in tris with the settled fixture,
+// settling and saving it first if there is none for this key
+void settlePile(std::vector<Triangle> &tris, std::vector<Triangle> &statics,
+                float width) {
+    std::vector<Triangle> fixed = statics;
+    Grid gr(tris, fixed, width * 2.0f);
+    for (int i = 0; i < PILE_PROBE_STEPS; i++) {
+        substep(gr);
+    }
+    std::string file = pileFixture(tris.size(), gr.bodies.stateHash());
+    std::vector<Triangle> loaded = std::vector<Triangle>();
+    if (loadSceneFile(file.c_str(), loaded) && loaded.size() == tris.size()) {
+        printf("pile: loaded %s\n", file.c_str());
+        tris.swap(loaded);
+        return;
+    }
+    // The pile starts at rest, packed tight, so it always runs a while
+    int steps = PILE_PROBE_STEPS;
+    float speed;
+    do {
+        for (int i = 0; i < PILE_SETTLE_CHECK; i++) {
+            substep(gr);
+        }
+        steps += PILE_SETTLE_CHECK;
+        speed = maxBodySpeed(gr.bodies);
+    } while (speed >= PILE_SETTLE_SPEED && steps < PILE_SETTLE_MAX);
+    printf("pile: %s after %d substeps, max speed %g\n",
+           speed < PILE_SETTLE_SPEED ? "settled" : "not settled", steps,
+           speed);
+    gr.bodies.writeTriangles(tris);
+    if (saveSceneBinary(file.c_str(), tris)) {
+        printf("pile: saved %s\n", file.c_str());
+    } else {
+        fprintf(stderr, "Failed to write %s\n", file.c_str());
+    }
+}
+
+// Builds one of kernelScenes
+void buildKernelScene(const std::string &name, std::vector<Triangle> &tris,
+                      std::vector<Triangle> &statics, float &width) {
+    if (name == "grid80") {
+        width = buildDefaultScene(tris, statics, 80);
+    } else if (name == "grid50k") {
+        width = buildDefaultScene(tris, statics, 224);
+    } else if (name == "grid500k") {
+        width = buildDefaultScene(tris, statics, 708);
+    } else if (name == "pile") {
+        width = buildPileScene(tris, statics, 6400);
+        settlePile(tris, statics, width);
+    } else {
+        width = buildCloudScene(tris, statics, 50000);
+    }
+}
+
+/*
+  The stages of a substep timed apart, then the Triangle kernels the
+  narrowphase grew out of on the candidate pairs of the last substep.
+  Each kernel gets warmup runs and then reps timed runs. Rows show the
+  median time per pair (per body for whole body passes) and per run,
+  the fastest run, the spread of the runs and the bodies a second the
+  median run works out to.
+ */
+void benchKernelScene(const std::string &name, int reps, int warmup) {
+    std::vector<Triangle> tris = std::vector<Triangle>();
+    std::vector<Triangle> statics = std::vector<Triangle>();
+    float width;
+    buildKernelScene(name, tris, statics, width);
+    Grid gr(tris, statics, width * 2.0f);
+    const char *scene = name.c_str();
+    unsigned int bodies = gr.bodies.size();
+
+    // Whole substeps, stage by stage, so each stage sees real motion
+    std::vector<double> stepTimes, sortTimes, pairTimes, rebalanceTimes;
+    unsigned long long pairCount = 0;
+    for (int r = -warmup; r < reps; r++) {
+        double t0 = getTime();
+        gr.stepAll(stepTime);
+        double t1 = getTime();
+        gr.initialSort();
+        double t2 = getTime();
+        gr.rebalance();
+        double t3 = getTime();
+        if (r >= 0) {
+            stepTimes.push_back(t1 - t0);
+            sortTimes.push_back(t2 - t1);
+            rebalanceTimes.push_back(t3 - t2);
+            pairCount += gr.pairs.size();
+        }
+    }
+    printKernel(scene, "Grid::stepAll", bodies, 0, stepTimes);
+    printKernel(scene, "Grid::initialSort", bodies, 0, sortTimes);
+    printKernel(scene, "Grid::rebalance", bodies, pairCount / reps,
+                rebalanceTimes);
+
+    // The last substep's pairs, split into the three Triangle kernels
+    unsigned int count = gr.pairs.size();
+    if (count == 0) {
+        return;
+    }
+    copyToSlots(gr.bodies, slotTris);
+    copyToSlots(gr.statics, slotStatics);
+    std::vector<glm::vec2> colVecs(count);
+    std::vector<glm::vec2> colPts(count);
+    std::vector<unsigned int> hits;
+    std::vector<unsigned int> found;
+    std::vector<double> satTimes, pointTimes, handleTimes;
+    for (int r = -warmup; r < reps; r++) {
+        hits.clear();
+        double beg = getTime();
+        for (unsigned int p = 0; p < count; p++) {
+            BodyPair &pair = gr.pairs[p];
+            std::vector<Triangle> &other = pair.isStatic ? slotStatics
+                : slotTris;
+            if (slotTris[pair.a].isCollision(other[pair.b], colVecs[p])) {
+                hits.push_back(p);
+            }
+        }
+        if (r >= 0) {
+            satTimes.push_back(getTime() - beg);
+        }
+    }
+    printKernel(scene, "isCollision", bodies, count, satTimes);
+    if (hits.empty()) {
+        return;
+    }
+
+    for (int r = -warmup; r < reps; r++) {
+        found.clear();
+        double beg = getTime();
+        for (unsigned int h = 0; h < hits.size(); h++) {
+            unsigned int p = hits[h];
+            BodyPair &pair = gr.pairs[p];
+            std::vector<Triangle> &other = pair.isStatic ? slotStatics
+                : slotTris;
+            if (slotTris[pair.a].findCollisionPt(other[pair.b], colVecs[p],
+                                                 colPts[p])) {
+                found.push_back(p);
+            }
+        }
+        if (r >= 0) {
+            pointTimes.push_back(getTime() - beg);
+        }
+    }
+    printKernel(scene, "findCollisionPt", bodies, hits.size(), pointTimes);
+    if (found.empty()) {
+        return;
+    }
+
+    // Velocities change every run, which does not change the work done
+    for (int r = -warmup; r < reps; r++) {
+        double beg = getTime();
+        for (unsigned int f = 0; f < found.size(); f++) {
+            unsigned int p = found[f];
+            BodyPair &pair = gr.pairs[p];
+            std::vector<Triangle> &other = pair.isStatic ? slotStatics
+                : slotTris;
+            slotTris[pair.a].handleCollisions(other[pair.b],
+                                              colPts[p] + colVecs[p],
+                                              -colVecs[p]);
+        }
+        if (r >= 0) {
+            handleTimes.push_back(getTime() - beg);
+        }
+    }
+    printKernel(scene, "handleCollisions", bodies, found.size(), handleTimes);
+}
+
+// Fixed seed scenes and kernel timings, for catching regressions
+int benchKernels(int argc, char *argv[]) {
+    int reps = 10;
+    int warmup = 3;
+    if (argc > 0) {
+        reps = std::max(atoi(argv[0]), 1);
+    }
+    if (argc > 1) {
+        warmup = std::max(atoi(argv[1]), 0);
+    }
+    std::vector<std::string> scenes;
+    for (int i = 2; i < argc; i++) {
+        scenes.push_back(argv[i]);
+    }
+    if (scenes.empty()) {
+        scenes.assign(kernelScenes, kernelScenes + KERNEL_SCENES);
+    }
+    for (unsigned int i = 0; i < scenes.size(); i++) {
+        if (std::find(kernelScenes, kernelScenes + KERNEL_SCENES,
+                      scenes[i]) == kernelScenes + KERNEL_SCENES) {
+            fprintf(stderr, "Unknown scene %s\n", scenes[i].c_str());
+            return 1;
+        }
+    }
+
+    printf("Repetitions: %d Warmup: %d Threads: %d Lanes: %d\n", reps,
+           warmup, omp_get_max_threads(), SIMD_LANES);
+    printf("%-10s %-17s %8s %9s %14s %9s %9s %7s %10s\n", "scene", "kernel",
+           "bodies", "pairs", "median ns per", "median ms", "min ms",
+           "spread", "bodies/s");
+    for (unsigned int i = 0; i < scenes.size(); i++) {
+        benchKernelScene(scenes[i], reps, warmup);
+    }
+    return 0;
+}
+
+// Substep cost of a pile left to fall asleep, against the same bodies
+// all awake
+int benchSleep(int argc, char *argv[]) {
+    int count = 1000;
+    int settle = 6000;
+    int substeps = 200;
+    if (argc > 0) {
+        count = atoi(argv[0]);
+    }
+    if (argc > 1) {
+        settle = atoi(argv[1]);
+    }
+    if (argc > 2) {
+        substeps = atoi(argv[2]);
+    }
+
+    std::vector<Triangle> tris = std::vector<Triangle>();
+    std::vector<Triangle> statics = std::vector<Triangle>();
+    float width = buildPileScene(tris, statics, count);
+    Grid gr(tris, statics, width * 2.0f);
+    gr.allowSleep = true;
+    double beg = getTime();
+    for (int f = 0; f < settle; f++) {
+        for (int i = 0; i < 10; i++) {
+            substep(gr);
+        }
+    }
+    double settleTime = getTime() - beg;
+
+    beg = getTime();
+    for (int i = 0; i < substeps; i++) {
+        substep(gr);
+    }
+    double asleep = (getTime() - beg) / substeps;
+    unsigned int sleeping = gr.islands.sleepingCount;
+    unsigned int islands = gr.islands.islandCount;
+
+    gr.islands.wakeAll(gr.bodies);
+    gr.allowSleep = false;
+    beg = getTime();
+    for (int i = 0; i < substeps; i++) {
+        substep(gr);
+    }
+    double awake = (getTime() - beg) / substeps;
+
+    std::cout << "Bodies: " << gr.bodies.size() << " Settled for " << settle
+              << " frames in " << settleTime << "s\n";
+    std::cout << "Sleeping: " << sleeping << " bodies, " << islands
+              << " awake islands\n";
+    std::cout << "With sleeping:    " << asleep * 1000 << " ms per substep\n";
+    std::cout << "All bodies awake: " << awake * 1000 << " ms per substep\n";
+    std::cout << "Speedup: " << awake / asleep << "x\n";
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    std::string mode = "pairs";
+    if (argc > 1) {
+        mode = argv[1];
+    }
+    if (mode == "pairs") {
+        return benchPairs(argc - 2, argv + 2);
+    } else if (mode == "broadphase") {
+        return benchBroadphase(argc - 2, argv + 2);
+    } else if (mode == "threads") {
+        return benchThreads(argc - 2, argv + 2);
+    } else if (mode == "integrate") {
+        return benchIntegrate(argc - 2, argv + 2);
+    } else if (mode == "trajectory") {
+        return benchTrajectory(argc - 2, argv + 2);
+    } else if (mode == "scene") {
+        return benchScene(argc - 2, argv + 2);
+    } else if (mode == "kernels") {
+        return benchKernels(argc - 2, argv + 2);
+    } else if (mode == "sleep") {
+        return benchSleep(argc - 2, argv + 2);
+    }
+    fprintf(stderr, "Unknown benchmark %s\n", mode.c_str());
+    return 1;
+}
@@ -0,0 +1,294 @@
+#include "aabbTree.hpp"
+
+#include <algorithm>
+
+// Perimeter is the insertion cost metric in 2D
+static float perimeter(float minX, float minY, float maxX, float maxY) {
+    return 2.0f * ((maxX - minX) + (maxY - minY));
+}
+
+static float unionPerimeter(const TreeNode &a, const TreeNode &b) {
+    return perimeter(std::min(a.minX, b.minX), std::min(a.minY, b.minY),
+                     std::max(a.maxX, b.maxX), std::max(a.maxY, b.maxY));
+}
+
+AabbTree::AabbTree(void) {
+    root = TREE_NULL;
+    freeList = TREE_NULL;
+    margin = 0.0f;
+    reinserts = 0;
+}
+
+void AabbTree::clear(void) {
+    nodes.clear();
+    root = TREE_NULL;
+    freeList = TREE_NULL;
+    reinserts = 0;
+}
+
+int AabbTree::allocNode(void) {
+    int index;
+    if (freeList != TREE_NULL) {
+        index = freeList;
+        freeList = nodes[index].parent;
+    } else {
+        index = nodes.size();
+        nodes.push_back(TreeNode());
+    }
+    TreeNode &node = nodes[index];
+    node.parent = TREE_NULL;
+    node.child1 = TREE_NULL;
+    node.child2 = TREE_NULL;
+    node.height = 0;
+    node.body = 0;
+    return index;
+}
+
+void AabbTree::freeNode(int index) {
+    nodes[index].parent = freeList;
+    nodes[index].height = -1;
+    freeList = index;
+}
+
+int AabbTree::insert(unsigned int body, float minX, float minY,
+                     float maxX, float maxY) {
+    int leaf = allocNode();
+    TreeNode &node = nodes[leaf];
+    node.minX = minX - margin;
+    node.minY = minY - margin;
+    node.maxX = maxX + margin;
+    node.maxY = maxY + margin;
+    node.body = body;
+    insertLeaf(leaf);
+    return leaf;
+}
+
+void AabbTree::remove(int leaf) {
+    removeLeaf(leaf);
+    freeNode(leaf);
+}
+
+bool AabbTree::update(int leaf, float minX, float minY,
+                      float maxX, float maxY) {
+    TreeNode &node = nodes[leaf];
+    if (node.minX <= minX && node.minY <= minY &&
+        node.maxX >= maxX && node.maxY >= maxY) {
+        return false;
+    }
+    removeLeaf(leaf);
+    TreeNode &moved = nodes[leaf];
+    moved.minX = minX - margin;
+    moved.minY = minY - margin;
+    moved.maxX = maxX + margin;
+    moved.maxY = maxY + margin;
+    insertLeaf(leaf);
+    reinserts++;
+    return true;
+}
+
+int AabbTree::height(void) const {
+    if (root == TREE_NULL) {
+        return 0;
+    }
+    return nodes[root].height;
+}
+
+// Box of index becomes the union of its children
+void AabbTree::refit(int index) {
+    TreeNode &node = nodes[index];
+    const TreeNode &c1 = nodes[node.child1];
+    const TreeNode &c2 = nodes[node.child2];
+    node.minX = std::min(c1.minX, c2.minX);
+    node.minY = std::min(c1.minY, c2.minY);
+    node.maxX = std::max(c1.maxX, c2.maxX);
+    node.maxY = std::max(c1.maxY, c2.maxY);
+    node.height = 1 + std::max(c1.height, c2.height);
+}
+
+void AabbTree::insertLeaf(int leaf) {
+    if (root == TREE_NULL) {
+        root = leaf;
+        nodes[root].parent = TREE_NULL;
+        return;
+    }
+
+    // Walk down to the sibling that grows the tree the least
+    int index = root;
+    while (nodes[index].height > 0) {
+        const TreeNode &node = nodes[index];
+        const TreeNode &leafNode = nodes[leaf];
+        int child1 = node.child1;
+        int child2 = node.child2;
+
+        float area = perimeter(node.minX, node.minY, node.maxX, node.maxY);
+        float combined = unionPerimeter(node, leafNode);
+        // Cost of making a new parent for this node and the leaf
+        float cost = 2.0f * combined;
+        // Minimum cost of pushing the leaf further down
+        float inheritance = 2.0f * (combined - area);
+
+        float cost1 = unionPerimeter(nodes[child1], leafNode) + inheritance;
+        if (nodes[child1].height > 0) {
+            const TreeNode &c = nodes[child1];
+            cost1 -= perimeter(c.minX, c.minY, c.maxX, c.maxY);
+        }
+        float cost2 = unionPerimeter(nodes[child2], leafNode) + inheritance;
+        if (nodes[child2].height > 0) {
+            const TreeNode &c = nodes[child2];
+            cost2 -= perimeter(c.minX, c.minY, c.maxX, c.maxY);
+        }
+
+        if (cost < cost1 && cost < cost2) {
+            break;
+        }
+        index = cost1 < cost2 ? child1 : child2;
+    }
+    int sibling = index;
+
+    // New parent for the sibling and the leaf
+    int oldParent = nodes[sibling].parent;
+    int newParent = allocNode();
+    nodes[newParent].parent = oldParent;
+    nodes[newParent].child1 = sibling;
+    nodes[newParent].child2 = leaf;
+    nodes[sibling].parent = newParent;
+    nodes[leaf].parent = newParent;
+    refit(newParent);
+
+    if (oldParent != TREE_NULL) {
+        if (nodes[oldParent].child1 == sibling) {
+            nodes[oldParent].child1 = newParent;
+        } else {
+            nodes[oldParent].child2 = newParent;
+        }
+    } else {
+        root = newParent;
+    }
+
+    // Walk back up fixing heights and boxes
+    index = nodes[leaf].parent;
+    while (index != TREE_NULL) {
+        index = balance(index);
+        refit(index);
+        index = nodes[index].parent;
+    }
+}
+
+void AabbTree::removeLeaf(int leaf) {
+    if (leaf == root) {
+        root = TREE_NULL;
+        return;
+    }
+
+    int parent = nodes[leaf].parent;
+    int grandParent = nodes[parent].parent;
+    int sibling = nodes[parent].child1 == leaf ?
+        nodes[parent].child2 : nodes[parent].child1;
+
+    if (grandParent != TREE_NULL) {
+        // Sibling takes the place of parent
+        if (nodes[grandParent].child1 == parent) {
+            nodes[grandParent].child1 = sibling;
+        } else {
+            nodes[grandParent].child2 = sibling;
+        }
+        nodes[sibling].parent = grandParent;
+        freeNode(parent);
+
+        int index = grandParent;
+        while (index != TREE_NULL) {
+            index = balance(index);
+            refit(index);
+            index = nodes[index].parent;
+        }
+    } else {
+        root = sibling;
+        nodes[sibling].parent = TREE_NULL;
+        freeNode(parent);
+    }
+}
+
+/*
+  If one child of a is more than one level taller than the other, rotate
+  the taller child up into a's place. Returns the index now at the top
+  of this subtree.
+ */
+int AabbTree::balance(int iA) {
+    TreeNode &A = nodes[iA];
+    if (A.height < 2) {
+        return iA;
+    }
+
+    int iB = A.child1;
+    int iC = A.child2;
+    int diff = nodes[iC].height - nodes[iB].height;
+
+    // Rotate C up
+    if (diff > 1) {
+        int iF = nodes[iC].child1;
+        int iG = nodes[iC].child2;
+        TreeNode &C = nodes[iC];
+
+        C.child1 = iA;
+        C.parent = A.parent;
+        A.parent = iC;
+        if (C.parent != TREE_NULL) {
+            if (nodes[C.parent].child1 == iA) {
+                nodes[C.parent].child1 = iC;
+            } else {
+                nodes[C.parent].child2 = iC;
+            }
+        } else {
+            root = iC;
+        }
+
+        // The taller grandchild stays under C
+        if (nodes[iF].height > nodes[iG].height) {
+            C.child2 = iF;
+            A.child2 = iG;
+            nodes[iG].parent = iA;
+        } else {
+            C.child2 = iG;
+            A.child2 = iF;
+            nodes[iF].parent = iA;
+        }
+        refit(iA);
+        refit(iC);
+        return iC;
+    }
+
+    // Rotate B up
+    if (diff < -1) {
+        int iD = nodes[iB].child1;
+        int iE = nodes[iB].child2;
+        TreeNode &B = nodes[iB];
+
+        B.child1 = iA;
+        B.parent = A.parent;
+        A.parent = iB;
+        if (B.parent != TREE_NULL) {
+            if (nodes[B.parent].child1 == iA) {
+                nodes[B.parent].child1 = iB;
+            } else {
+                nodes[B.parent].child2 = iB;
+            }
+        } else {
+            root = iB;
+        }
+
+        if (nodes[iD].height > nodes[iE].height) {
+            B.child2 = iD;
+            A.child1 = iE;
+            nodes[iE].parent = iA;
+        } else {
+            B.child2 = iE;
+            A.child1 = iD;
+            nodes[iD].parent = iA;
+        }
+        refit(iA);
+        refit(iB);
+        return iB;
+    }
+
+    return iA;
+}
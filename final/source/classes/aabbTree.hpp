@@ -0,0 +1,116 @@
+#ifndef __AABBTREE_H
+#define __AABBTREE_H
+
+#include <vector>
+
+#define TREE_NULL -1
+// Deep enough for any tree the balancing lets us build
+#define TREE_STACK 256
+
+// Bounding box with a body attached, the unit stored in an AabbTree
+struct TreeNode {
+    float minX;
+    float minY;
+    float maxX;
+    float maxY;
+    // Parent, or next free node when on the free list
+    int parent;
+    int child1;
+    int child2;
+    // 0 for leaves, -1 for free nodes
+    int height;
+    // Body id or slot held by a leaf
+    unsigned int body;
+};
+
+/*
+  Dynamic bounding volume tree. Leaves hold a box grown by margin so a
+  body can move a little before its leaf needs to be reinserted.
+  Inserts pick the sibling with the cheapest perimeter growth and the
+  tree is kept balanced with AVL style rotations.
+ */
+class AabbTree {
+public:
+    std::vector<TreeNode> nodes;
+    int root;
+    int freeList;
+    // How far a leaf's box is grown past the body's box
+    float margin;
+    // Number of leaves reinserted by update since last reset
+    unsigned int reinserts;
+
+    AabbTree(void);
+    void clear(void);
+
+    // Returns the leaf index for body
+    int insert(unsigned int body, float minX, float minY,
+               float maxX, float maxY);
+    void remove(int leaf);
+    // Reinsert leaf if the tight box has left its fattened box
+    bool update(int leaf, float minX, float minY, float maxX, float maxY);
+    int height(void) const;
+
+    // Calls visit(body) for every leaf whose box overlaps the given one
+    template <typename Visitor>
+    void query(float minX, float minY, float maxX, float maxY,
+               Visitor &visit) const {
+        if (root == TREE_NULL) {
+            return;
+        }
+        search(root, minX, minY, maxX, maxY, visit);
+    }
+
+    /*
+      Like query, but only visits leaves ordered before leaf, child1
+      subtrees before child2. Walks up from leaf and searches the child1
+      side of every ancestor leaf sits under child2 of. Run for every
+      leaf, each overlapping pair is visited once, from its later leaf,
+      and leaf never meets itself.
+     */
+    template <typename Visitor>
+    void queryBefore(int leaf, float minX, float minY, float maxX,
+                     float maxY, Visitor &visit) const {
+        int child = leaf;
+        int parent = nodes[leaf].parent;
+        while (parent != TREE_NULL) {
+            const TreeNode &up = nodes[parent];
+            if (up.child2 == child) {
+                search(up.child1, minX, minY, maxX, maxY, visit);
+            }
+            child = parent;
+            parent = up.parent;
+        }
+    }
+
+private:
+    // Visits the leaves under start that overlap the box
+    template <typename Visitor>
+    void search(int start, float minX, float minY, float maxX, float maxY,
+                Visitor &visit) const {
+        int stack[TREE_STACK];
+        int top = 0;
+        stack[top++] = start;
+        while (top > 0) {
+            const TreeNode &node = nodes[stack[--top]];
+            if (node.minX > maxX || node.minY > maxY ||
+                node.maxX < minX || node.maxY < minY) {
+                continue;
+            }
+            if (node.height == 0) {
+                visit(node.body);
+            } else {
+                stack[top++] = node.child1;
+                stack[top++] = node.child2;
+            }
+        }
+    }
+
+    int allocNode(void);
+    void freeNode(int index);
+    void insertLeaf(int leaf);
+    void removeLeaf(int leaf);
+    int balance(int index);
+    void refit(int index);
+};
+
+#endif
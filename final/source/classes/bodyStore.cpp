@@ -0,0 +1,359 @@
+#include "bodyStore.hpp"
+
+#include <glm.hpp>
+
+#include "simd.hpp"
+
+BodyStore::BodyStore(void) {
+    drag = 0.9995f;
+}
+
+unsigned int BodyStore::size(void) const {
+    return idOf.size();
+}
+
+unsigned int BodyStore::numShapes(void) const {
+    return shapes.size();
+}
+
+void BodyStore::reserve(unsigned int n) {
+    midX.reserve(n);
+    midY.reserve(n);
+    angle.reserve(n);
+    cosA.reserve(n);
+    sinA.reserve(n);
+    shape.reserve(n);
+    velX.reserve(n);
+    velY.reserve(n);
+    angVel.reserve(n);
+    invMass.reserve(n);
+    for (int i = 0; i < 3; i++) {
+        vertX[i].reserve(n);
+        vertY[i].reserve(n);
+    }
+    dirty.reserve(n);
+    dirtySlots.reserve(n);
+    moving.reserve(n);
+    asleep.reserve(n);
+    minX.reserve(n);
+    minY.reserve(n);
+    maxX.reserve(n);
+    maxY.reserve(n);
+    idOf.reserve(n);
+    slotOf.reserve(n);
+}
+
+unsigned int BodyStore::add(Triangle &t) {
+    unsigned int slot = size();
+    unsigned int id = slotOf.size();
+    midX.push_back(0.0f);
+    midY.push_back(0.0f);
+    angle.push_back(0.0f);
+    cosA.push_back(1.0f);
+    sinA.push_back(0.0f);
+    shape.push_back(0);
+    velX.push_back(t.velocity[0]);
+    velY.push_back(t.velocity[1]);
+    angVel.push_back(t.rotationalVelocity);
+    invMass.push_back(t.invMass);
+    for (int i = 0; i < 3; i++) {
+        vertX[i].push_back(0.0f);
+        vertY[i].push_back(0.0f);
+    }
+    minX.push_back(0.0f);
+    minY.push_back(0.0f);
+    maxX.push_back(0.0f);
+    maxY.push_back(0.0f);
+    dirty.push_back(0);
+    asleep.push_back(0);
+    if (t.invMass != 0.0f) {
+        moving.push_back(slot);
+    }
+    idOf.push_back(id);
+    slotOf.push_back(slot);
+    setVertices(slot, t.verts[0], t.verts[1], t.verts[2]);
+    return id;
+}
+
+void BodyStore::load(unsigned int slot, Triangle &t) {
+    for (int i = 0; i < 3; i++) {
+        t.verts[i] = glm::vec2(vertX[i][slot], vertY[i][slot]);
+    }
+    t.velocity = glm::vec2(velX[slot], velY[slot]);
+    t.rotationalVelocity = angVel[slot];
+    t.invMass = invMass[slot];
+}
+
+void BodyStore::gather(unsigned int slot, BodyView &v) {
+    unsigned int s = shape[slot];
+    float c = cosA[slot], sn = sinA[slot];
+    for (int i = 0; i < 3; i++) {
+        v.pts[i] = glm::vec2(vertX[i][slot], vertY[i][slot]);
+        float nx = shapes.normX[i][s], ny = shapes.normY[i][s];
+        v.norms[i] = glm::vec2(nx * c - ny * sn, nx * sn + ny * c);
+    }
+    v.mid = glm::vec2(midX[slot], midY[slot]);
+}
+
+// The vertices given are the body at angle 0
+void BodyStore::setVertices(unsigned int slot, glm::vec2 &v0, glm::vec2 &v1,
+                            glm::vec2 &v2) {
+    glm::vec2 mid = (v0 + v1 + v2) / 3.0f;
+    glm::vec2 local[3] = { v0 - mid, v1 - mid, v2 - mid };
+    midX[slot] = mid[0];
+    midY[slot] = mid[1];
+    angle[slot] = 0.0f;
+    shape[slot] = shapes.find(local);
+    markDirty(slot);
+}
+
+void BodyStore::storeVelocity(unsigned int slot, Triangle &t) {
+    velX[slot] = t.velocity[0];
+    velY[slot] = t.velocity[1];
+    angVel[slot] = t.rotationalVelocity;
+}
+
+void BodyStore::updateCache(unsigned int slot) {
+    unsigned int s = shape[slot];
+    float a = glm::radians(angle[slot]);
+    float c = glm::cos(a);
+    float sn = glm::sin(a);
+    cosA[slot] = c;
+    sinA[slot] = sn;
+    float mx = midX[slot], my = midY[slot];
+    for (int i = 0; i < 3; i++) {
+        float lx = shapes.vertX[i][s], ly = shapes.vertY[i][s];
+        vertX[i][slot] = mx + (lx * c - ly * sn);
+        vertY[i][slot] = my + (lx * sn + ly * c);
+    }
+    updateBounds(slot);
+}
+
+void BodyStore::updateBounds(unsigned int slot) {
+    float x0 = vertX[0][slot], x1 = vertX[1][slot], x2 = vertX[2][slot];
+    float y0 = vertY[0][slot], y1 = vertY[1][slot], y2 = vertY[2][slot];
+    minX[slot] = std::min(x0, std::min(x1, x2));
+    maxX[slot] = std::max(x0, std::max(x1, x2));
+    minY[slot] = std::min(y0, std::min(y1, y2));
+    maxY[slot] = std::max(y0, std::max(y1, y2));
+}
+
+void BodyStore::markDirty(unsigned int slot) {
+    if (!dirty[slot]) {
+        dirty[slot] = 1;
+        dirtySlots.push_back(slot);
+    }
+}
+
+void BodyStore::refreshDirty(void) {
+    for (unsigned int i = 0; i < dirtySlots.size(); i++) {
+        unsigned int slot = dirtySlots[i];
+        updateCache(slot);
+        dirty[slot] = 0;
+    }
+    dirtySlots.clear();
+}
+
+bool BodyStore::aabbOverlap(unsigned int slot, BodyStore &other,
+                            unsigned int otherSlot) {
+	//Fail fast
+    if (minX[slot] > other.maxX[otherSlot] ||
+        minY[slot] > other.maxY[otherSlot] ||
+        maxX[slot] < other.minX[otherSlot] ||
+        maxY[slot] < other.minY[otherSlot]) {
+        return false;
+    }
+    return true;
+}
+
+// Moves the triangle forward in time by delta applying gravity
+void BodyStore::timeStep(unsigned int slot, float delta) {
+    if (invMass[slot] == 0.0f) {
+        return;
+    }
+    float a = angle[slot] + angVel[slot] * delta;
+    if (a > 180.0f) {
+        a -= 360.0f;
+    } else if (a < -180.0f) {
+        a += 360.0f;
+    }
+    angle[slot] = a;
+    midX[slot] += velX[slot] * delta;
+    midY[slot] += velY[slot] * delta;
+    velY[slot] += -10.0f * delta;
+    //Simulate air drag
+    angVel[slot] *= drag;
+    velX[slot] *= drag;
+    velY[slot] *= drag;
+    updateCache(slot);
+}
+
+/*
+  timeStep and updateCache for SIMD_LANES neighbouring slots, one body
+  per lane. Only sin and cos and the reads of each lane's shape stay
+  scalar.
+ */
+void BodyStore::stepGroup(unsigned int first, float delta) {
+#if SIMD_LANES > 1
+    const int L = SIMD_LANES;
+    vfloat d = vset(delta);
+    vfloat half = vset(180.0f);
+    vfloat full = vset(360.0f);
+    vfloat a = vadd(vload(&angle[first]), vmul(vload(&angVel[first]), d));
+    a = vsub(a, vand(vgt(a, half), full));
+    a = vadd(a, vand(vlt(a, vsub(vset(0.0f), half)), full));
+    vstore(&angle[first], a);
+
+    float lx[3][L], ly[3][L];
+    for (int l = 0; l < L; l++) {
+        float r = glm::radians(angle[first + l]);
+        cosA[first + l] = glm::cos(r);
+        sinA[first + l] = glm::sin(r);
+        unsigned int s = shape[first + l];
+        for (int i = 0; i < 3; i++) {
+            lx[i][l] = shapes.vertX[i][s];
+            ly[i][l] = shapes.vertY[i][s];
+        }
+    }
+    vfloat c = vload(&cosA[first]);
+    vfloat s = vload(&sinA[first]);
+
+    vfloat vx = vload(&velX[first]);
+    vfloat vy = vload(&velY[first]);
+    vfloat mx = vadd(vload(&midX[first]), vmul(vx, d));
+    vfloat my = vadd(vload(&midY[first]), vmul(vy, d));
+    vstore(&midX[first], mx);
+    vstore(&midY[first], my);
+    vfloat keep = vset(drag);
+    vy = vadd(vy, vset(-10.0f * delta));
+    vstore(&velX[first], vmul(vx, keep));
+    vstore(&velY[first], vmul(vy, keep));
+    vstore(&angVel[first], vmul(vload(&angVel[first]), keep));
+
+    vfloat x[3], y[3];
+    for (int i = 0; i < 3; i++) {
+        vfloat px = vload(lx[i]);
+        vfloat py = vload(ly[i]);
+        x[i] = vadd(mx, vsub(vmul(px, c), vmul(py, s)));
+        y[i] = vadd(my, vadd(vmul(px, s), vmul(py, c)));
+        vstore(&vertX[i][first], x[i]);
+        vstore(&vertY[i][first], y[i]);
+    }
+    // Arguments swapped to pick the same side as std::min and std::max
+    vstore(&minX[first], vmin(vmin(x[2], x[1]), x[0]));
+    vstore(&maxX[first], vmax(vmax(x[2], x[1]), x[0]));
+    vstore(&minY[first], vmin(vmin(y[2], y[1]), y[0]));
+    vstore(&maxY[first], vmax(vmax(y[2], y[1]), y[0]));
+#else
+    timeStep(first, delta);
+#endif
+}
+
+void BodyStore::stepAll(float delta) {
+    stepRange(0, moving.size(), delta);
+}
+
+// Runs of SIMD_LANES neighbouring slots go through stepGroup, the rest
+// one at a time
+void BodyStore::stepRange(unsigned int begin, unsigned int end, float delta) {
+    unsigned int i = begin;
+    while (i < end) {
+        unsigned int slot = moving[i];
+        if (i + SIMD_LANES <= end &&
+            moving[i + SIMD_LANES - 1] == slot + SIMD_LANES - 1) {
+            stepGroup(slot, delta);
+            i += SIMD_LANES;
+        } else {
+            timeStep(slot, delta);
+            i++;
+        }
+    }
+}
+
+void BodyStore::findMoving(void) {
+    moving.clear();
+    for (unsigned int i = 0; i < invMass.size(); i++) {
+        if (invMass[i] != 0.0f && !asleep[i]) {
+            moving.push_back(i);
+        }
+    }
+}
+
+void BodyStore::permuteArray(std::vector<float> &arr,
+                             std::vector<unsigned int> &order) {
+    scratch.resize(arr.size());
+    for (unsigned int i = 0; i < order.size(); i++) {
+        scratch[i] = arr[order[i]];
+    }
+    arr.swap(scratch);
+}
+
+void BodyStore::permuteArray(std::vector<unsigned int> &arr,
+                             std::vector<unsigned int> &order) {
+    scratchIds.resize(arr.size());
+    for (unsigned int i = 0; i < order.size(); i++) {
+        scratchIds[i] = arr[order[i]];
+    }
+    arr.swap(scratchIds);
+}
+
+void BodyStore::permuteArray(std::vector<unsigned char> &arr,
+                             std::vector<unsigned int> &order) {
+    scratchFlags.resize(arr.size());
+    for (unsigned int i = 0; i < order.size(); i++) {
+        scratchFlags[i] = arr[order[i]];
+    }
+    arr.swap(scratchFlags);
+}
+
+void BodyStore::permute(std::vector<unsigned int> &order) {
+    //Slots move, so settle any pending rebuilds first
+    refreshDirty();
+    permuteArray(midX, order);
+    permuteArray(midY, order);
+    permuteArray(angle, order);
+    permuteArray(cosA, order);
+    permuteArray(sinA, order);
+    permuteArray(shape, order);
+    permuteArray(velX, order);
+    permuteArray(velY, order);
+    permuteArray(angVel, order);
+    permuteArray(invMass, order);
+    permuteArray(asleep, order);
+    for (int i = 0; i < 3; i++) {
+        permuteArray(vertX[i], order);
+        permuteArray(vertY[i], order);
+    }
+    permuteArray(minX, order);
+    permuteArray(minY, order);
+    permuteArray(maxX, order);
+    permuteArray(maxY, order);
+
+    scratchIds.resize(idOf.size());
+    for (unsigned int i = 0; i < order.size(); i++) {
+        scratchIds[i] = idOf[order[i]];
+        slotOf[scratchIds[i]] = i;
+    }
+    idOf.swap(scratchIds);
+    findMoving();
+}
+
+void BodyStore::writeTriangles(std::vector<Triangle> &tris) {
+    for (unsigned int id = 0; id < slotOf.size() && id < tris.size(); id++) {
+        load(slotOf[id], tris[id]);
+    }
+}
+
+unsigned int BodyStore::stateHash(void) const {
+    unsigned int hash = 2166136261u;
+    for (unsigned int id = 0; id < slotOf.size(); id++) {
+        unsigned int slot = slotOf[id];
+        float v[6] = { midX[slot], midY[slot], angle[slot], velX[slot],
+                       velY[slot], angVel[slot] };
+        const unsigned char *bytes = (const unsigned char *)v;
+        for (unsigned int i = 0; i < sizeof(v); i++) {
+            hash = (hash ^ bytes[i]) * 16777619u;
+        }
+    }
+    return hash;
+}
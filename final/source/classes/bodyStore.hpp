@@ -0,0 +1,129 @@
+#ifndef __BODYSTORE_H
+#define __BODYSTORE_H
+
+#include <vector>
+#include <glm.hpp>
+
+#include "triangle.hpp"
+#include "shapeRegistry.hpp"
+
+// Structure-of-arrays storage for triangle bodies. Each per body quantity
+// lives in its own contiguous array indexed by slot. Grid reorders slots to
+// keep bodies in spatial order, so anything outside the store should refer
+// to a body by its id, which stays fixed and is mapped to a slot through
+// the handle table.
+//
+// A body is its centroid, an angle and a shape shared with every body of
+// the same form. World vertices are a cache rebuilt from those, so
+// vertices never drift from repeated rotation. Edge normals are not kept
+// per body; gather turns the shape's normals by the body's rotation.
+class BodyStore {
+public:
+    ShapeRegistry shapes;
+
+    //Position is the centroid
+    std::vector<float> midX;
+    std::vector<float> midY;
+    //Degrees counterclockwise, kept within [-180, 180]
+    std::vector<float> angle;
+    //Cached cosine and sine of angle
+    std::vector<float> cosA;
+    std::vector<float> sinA;
+    std::vector<unsigned int> shape;
+    //Physics info
+    std::vector<float> velX;
+    std::vector<float> velY;
+    std::vector<float> angVel;
+    std::vector<float> invMass;
+    //Cached world vertices, one array per corner
+    std::vector<float> vertX[3];
+    std::vector<float> vertY[3];
+    //Cached bounding box
+    std::vector<float> minX;
+    std::vector<float> minY;
+    std::vector<float> maxX;
+    std::vector<float> maxY;
+
+    //Slots of awake bodies with mass in increasing order. Integration
+    //walks this list, so static and sleeping bodies in the store are
+    //skipped without a test
+    std::vector<unsigned int> moving;
+    //Set for bodies put to sleep by Islands
+    std::vector<unsigned char> asleep;
+    //Fraction of velocity kept each step, for air drag
+    float drag;
+
+    //Bodies that integration does not touch (statics) only get their
+    //cache rebuilt when flagged here
+    std::vector<unsigned char> dirty;
+    std::vector<unsigned int> dirtySlots;
+
+    //Handle table. idOf[slot] is the body id, slotOf[id] its current slot
+    std::vector<unsigned int> idOf;
+    std::vector<unsigned int> slotOf;
+
+    BodyStore(void);
+
+    unsigned int size(void) const;
+    unsigned int numShapes(void) const;
+    void reserve(unsigned int n);
+    //Append t as a new body, returns its id
+    unsigned int add(Triangle &t);
+
+    //Copy the body in slot out to / velocities back from a Triangle
+    void load(unsigned int slot, Triangle &t);
+    void storeVelocity(unsigned int slot, Triangle &t);
+
+    //Narrowphase data of slot, no Triangle is built
+    void gather(unsigned int slot, BodyView &v);
+    //Place slot at these vertices, finding or adding its shape, and flag
+    //its cache for a rebuild
+    void setVertices(unsigned int slot, glm::vec2 &v0, glm::vec2 &v1,
+                     glm::vec2 &v2);
+
+    //Cached bounding box test between slot and otherSlot of other
+    bool aabbOverlap(unsigned int slot, BodyStore &other,
+                     unsigned int otherSlot);
+
+    //Rebuild cached rotation, vertices and bounding box from the position,
+    //angle and shape
+    void updateCache(unsigned int slot);
+    void updateBounds(unsigned int slot);
+    void markDirty(unsigned int slot);
+    //Rebuild the cache of every flagged body
+    void refreshDirty(void);
+
+    //Moves the body forward in time by delta applying gravity
+    void timeStep(unsigned int slot, float delta);
+    void stepAll(float delta);
+    // Steps the bodies in moving[begin, end)
+    void stepRange(unsigned int begin, unsigned int end, float delta);
+
+    //Reorder so that new slot i holds the body that was in slot order[i]
+    void permute(std::vector<unsigned int> &order);
+
+    //Rebuild moving after invMass or asleep changed
+    void findMoving(void);
+
+    //Write every body back out in id order
+    void writeTriangles(std::vector<Triangle> &tris);
+
+    //FNV-1a hash of every body's position, angle and velocities in id
+    //order. Equal hashes mean bit identical states.
+    unsigned int stateHash(void) const;
+
+private:
+    std::vector<float> scratch;
+    std::vector<unsigned int> scratchIds;
+    std::vector<unsigned char> scratchFlags;
+    void permuteArray(std::vector<float> &arr,
+                      std::vector<unsigned int> &order);
+    void permuteArray(std::vector<unsigned int> &arr,
+                      std::vector<unsigned int> &order);
+    void permuteArray(std::vector<unsigned char> &arr,
+                      std::vector<unsigned int> &order);
+    // timeStep for the SIMD_LANES slots starting at first
+    void stepGroup(unsigned int first, float delta);
+};
+
+#endif
@@ -0,0 +1,84 @@
+#include "cellGrid.hpp"
+
+#include <cmath>
+
+CellGrid::CellGrid(void) {
+    cellSize = 1.0f;
+    tableSize = 0;
+}
+
+unsigned int CellGrid::hashCell(int x, int y) {
+    unsigned int h = (unsigned int)x * 73856093u ^ (unsigned int)y * 19349663u;
+    return h & (tableSize - 1);
+}
+
+void CellGrid::build(BodyStore &bodies, float size) {
+    unsigned int count = bodies.size();
+    cellSize = size;
+    // About two buckets per body keeps hash clashes rare
+    tableSize = 64;
+    while (tableSize < 2 * count) {
+        tableSize *= 2;
+    }
+
+    cellX.resize(count);
+    cellY.resize(count);
+    bucketOf.resize(count);
+    cellBodies.resize(count);
+    cellStart.assign(tableSize + 1, 0);
+
+    //count bodies per bucket
+    float inv = 1.0f / cellSize;
+    for (unsigned int i = 0; i < count; i++) {
+        cellX[i] = (int)floorf(bodies.midX[i] * inv);
+        cellY[i] = (int)floorf(bodies.midY[i] * inv);
+        bucketOf[i] = hashCell(cellX[i], cellY[i]);
+        cellStart[bucketOf[i] + 1]++;
+    }
+    //prefix sum into the start of each bucket
+    for (unsigned int b = 0; b < tableSize; b++) {
+        cellStart[b + 1] += cellStart[b];
+    }
+    //scatter, slots stay in increasing order within a bucket
+    std::vector<unsigned int> &fill = bucketFill;
+    fill.assign(cellStart.begin(), cellStart.end() - 1);
+    for (unsigned int i = 0; i < count; i++) {
+        cellBodies[fill[bucketOf[i]]++] = i;
+    }
+}
+
+unsigned long long CellGrid::findPairs(BodyStore &bodies,
+                                      std::vector<BodyPair> &pairs,
+                                      unsigned int begin, unsigned int end) {
+    unsigned long long tests = 0;
+    BodyPair pair;
+    pair.isStatic = false;
+    for (unsigned int a = begin; a < end; a++) {
+        pair.a = a;
+        //look at the 3 x 3 block of cells around a
+        for (int dy = -1; dy <= 1; dy++) {
+            for (int dx = -1; dx <= 1; dx++) {
+                int x = cellX[a] + dx;
+                int y = cellY[a] + dy;
+                unsigned int bucket = hashCell(x, y);
+                unsigned int last = cellStart[bucket + 1];
+                for (unsigned int i = cellStart[bucket]; i < last; i++) {
+                    unsigned int b = cellBodies[i];
+                    // Each pair once, and skip other cells sharing the bucket
+                    if (b >= a) {
+                        break;
+                    }
+                    if (cellX[b] != x || cellY[b] != y) {
+                        continue;
+                    }
+                    tests++;
+                    if (bodies.aabbOverlap(a, bodies, b)) {
+                        pair.b = b;
+                        pairs.push_back(pair);
+                    }
+                }
+            }
+        }
+    }
+    return tests;
+}
@@ -0,0 +1,43 @@
+#ifndef __CELLGRID_H
+#define __CELLGRID_H
+
+#include <vector>
+
+#include "bodyStore.hpp"
+#include "narrowphase.hpp"
+
+// Uniform grid broadphase. Space is cut into square cells at least as
+// wide as the largest body and cells are hashed into a table, so the
+// scene can be any size. Bodies are grouped by bucket with a counting
+// sort which gives every bucket a contiguous range of slots.
+class CellGrid {
+public:
+    float cellSize;
+    // Number of buckets, a power of two
+    unsigned int tableSize;
+
+    // Cell coordinates and bucket of each slot
+    std::vector<int> cellX;
+    std::vector<int> cellY;
+    std::vector<unsigned int> bucketOf;
+    // Bodies of bucket b are cellBodies[cellStart[b] .. cellStart[b + 1])
+    std::vector<unsigned int> cellStart;
+    std::vector<unsigned int> cellBodies;
+
+    // Scratch write cursor per bucket while building
+    std::vector<unsigned int> bucketFill;
+
+    CellGrid(void);
+
+    unsigned int hashCell(int x, int y);
+    // Bucket every body by the cell holding its centroid
+    void build(BodyStore &bodies, float size);
+    // Append every overlapping pair of moving bodies whose higher slot is
+    // in [begin, end) and return the number of bounding box tests. Only
+    // reads the grid, so slot ranges can run in parallel.
+    unsigned long long findPairs(BodyStore &bodies,
+                                 std::vector<BodyPair> &pairs,
+                                 unsigned int begin, unsigned int end);
+};
+
+#endif
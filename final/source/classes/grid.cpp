@@ -4,106 +4,150 @@
 #include <string>
 #include <unordered_map>
 #include <iterator>
+#include <algorithm>
 
 #include "grid.hpp"
 #include <omp.h>
 #include "pthread.h"
 
 #define LINEAR 0
-#define NUMTHREADS 1
+// Slot ranges the chunked broadphases split into. Fixed so the pair
+// order never depends on the thread count.
+#define PAIR_CHUNKS 64
+// Pairs per narrowphase chunk of the step graph
+#define NARROW_GRAIN 512
+// Shifts per body the insertion sort may do before switching to radix
+#define SORT_MAX_MOVES 8
+// Fattening of moving tree leaves as a fraction of triSize
+#define TREE_MARGIN 0.1f
 
-/* Copy over inputs. Call initialSort */
-Grid::Grid(std::vector<Triangle> &trs, std::vector<Triangle> &stats, float trSize) {
-    tris = std::vector<Triangle *>();
+/* Copy over inputs. Body ids match positions in trs. Call initialSort */
+Grid::Grid(std::vector<Triangle> &trs, std::vector<Triangle> &stats, float trSize,
+           BroadphaseType type) {
+    bodies.reserve(trs.size());
     for (unsigned int i = 0; i < trs.size(); i++) {
-        tris.push_back(&trs[i]);
+        bodies.add(trs[i]);
     }
-    statics = std::vector<Triangle *>();
     for (unsigned int i = 0; i < stats.size(); i++) {
-        statics.push_back(&stats[i]);
+        statics.add(stats[i]);
     }
+    bodies.refreshDirty();
+    statics.refreshDirty();
     indices = std::vector<unsigned int>();
+    order = std::vector<unsigned int>();
+    sortedOnce = false;
+    sortMoves = 0;
+    sortUsedRadix = false;
+    pairTests = 0;
+    useCache = false;
+    deterministic = false;
+    contactScale = 1.0f;
+    allowSleep = false;
+    skipSleepingRows = false;
+    numThreads = omp_get_max_threads();
+    pool = NULL;
+    stepDelta = 0.0f;
     triSize = trSize;
+    broadphase = type;
+
+    for (unsigned int i = 0; i < statics.size(); i++) {
+        staticLeaf.push_back(staticTree.insert(i, statics.minX[i],
+                                               statics.minY[i],
+                                               statics.maxX[i],
+                                               statics.maxY[i]));
+    }
+    if (broadphase == TREE_BROADPHASE) {
+        tree.margin = TREE_MARGIN * triSize;
+        // Bodies are never sorted in tree mode, so leaves can hold slots
+        for (unsigned int i = 0; i < bodies.size(); i++) {
+            treeLeaf.push_back(tree.insert(i, bodies.minX[i],
+                                           bodies.minY[i], bodies.maxX[i],
+                                           bodies.maxY[i]));
+        }
+    }
+    profiler = NULL;
     initialSort();
 }
 
-// True if t1 is less than or equal to t2
-bool Grid::compare(Triangle *t1, Triangle *t2) {
-    glm::vec2 mid1 = t1->midPt();
-    glm::vec2 mid2 = t2->midPt();
-    int index1 = (int)((high - mid1[1]) / triSize);
-    int index2 = (int)((high - mid2[1]) / triSize);
-    if (index1 < index2) {
-        return true;
-    } else if (index1 > index2) {
-        return false;
-    }
-    return mid1[0] <= mid2[0];
-}
-
-int Grid::partition(unsigned int left, unsigned int right, unsigned int pivot) {
-    Triangle *pivotVal = tris[pivot];
-    Triangle *temp = tris[right];
-    tris[right] = pivotVal;
-    tris[pivot] = temp;
-    unsigned int mid = left;
-    for (unsigned int i = left; i < right; i++) {
-        Triangle * ll = tris[i];
-        bool cmp = compare(tris[i], pivotVal);
-        if (cmp) {
-            temp = tris[mid];
-            tris[mid] = tris[i];
-            tris[i] = temp;
-            ++mid;
-        }
-    }
-    temp = tris[right];
-    tris[right] = tris[mid];
-    tris[mid] = temp;
-    return mid;
-}
-
-void Grid::quicksort(unsigned int left, unsigned int right) {
-    if (left < right) {
-        unsigned int pivot = (left + right) / 2;
-        pivot = partition(left, right, pivot);
-        if (pivot == left) {
-            quicksort(left, pivot);
-        } else {
-            quicksort(left, pivot - 1);
-        }
-        quicksort(pivot + 1, right);
+// Sort keys for every slot: row from the top, then x within the row
+void Grid::computeKeys(void) {
+    int count = bodies.size();
+    keys.resize(count);
+    order.resize(count);
+#pragma omp parallel for schedule(static) num_threads(numThreads)
+    for (int i = 0; i < count; i++) {
+        setKey(i);
     }
 }
 
+void Grid::setKey(unsigned int i) {
+    int row = (int)((high - bodies.midY[i]) / triSize);
+    keys[i] = makeKey(row, bodies.midX[i]);
+    order[i] = i;
+}
 
-//quickSort over all triangles
+// Sort all triangles into (row, x) order. Bodies barely move between
+// substeps so the previous order is nearly right and an insertion sort
+// does it in close to linear time. The first sort, or one where too
+// much has moved, falls back to a radix sort.
 void Grid::initialSort(void) {
-    if (tris.size() == 0) return;
+    if (bodies.size() == 0) return;
+    ProfileScope scope(profiler, PHASE_SORT);
+    findBounds();
+    if (keepsSlots()) {
+        return;
+    }
+    computeKeys();
+    sortKeys();
+}
+
+// Sweep and prune and the tree hold bodies by slot and find pairs without
+// any order, so their bodies stay where they are
+bool Grid::keepsSlots(void) {
+    return broadphase == SWEEP_BROADPHASE || broadphase == TREE_BROADPHASE;
+}
+
+void Grid::findBounds(void) {
+    unsigned int count = bodies.size();
+    sortMoves = 0;
+    sortUsedRadix = false;
+    if (count == 0) return;
 
     //find min and max
-    float triY = tris[0]->midPt()[1];
+    float triY = bodies.midY[0];
     high = triY;
     low = triY;
-    for (unsigned int i = 1; i < tris.size(); i++) {
-        triY = tris[i]->midPt()[1];
+    for (unsigned int i = 1; i < count; i++) {
+        triY = bodies.midY[i];
         if (triY > high) {
             high = triY;
         } else if (triY < low) {
             low = triY;
         }
     }
+}
 
-    //QuickSort in place
-    quicksort(0, tris.size() - 1);
+void Grid::sortKeys(void) {
+    unsigned int count = bodies.size();
+    if (!sortedOnce ||
+        !insertionSortKeys(keys, order,
+                           (unsigned long long)count * SORT_MAX_MOVES,
+                           sortMoves)) {
+        radixSortKeys(keys, order, keyScratch, orderScratch, teamThreads());
+        sortUsedRadix = true;
+    }
+    sortedOnce = true;
+    // Move the bodies into the sorted order in one pass
+    if (sortMoves > 0 || sortUsedRadix) {
+        bodies.permute(order);
+    }
 
     //discover indices
     indices.clear();
     indices.push_back(0);
-    int prevDiv;
-    prevDiv = (int)((high - tris[0]->midPt()[1]) / triSize);
-    for (unsigned int i = 1; i < tris.size(); i++) {
-        int div = (int)((high - tris[i]->midPt()[1]) / triSize);
+    int prevDiv = keyRow(keys[0]);
+    for (unsigned int i = 1; i < count; i++) {
+        int div = keyRow(keys[i]);
         if (div != prevDiv) {
             indices.push_back(i);
             prevDiv = div;
@@ -116,159 +160,845 @@ void *Grid::pThreadStrip(void * input) {
     return (pti->grid)->itterateOnStrip(pti->start, pti->size, pti->stride);
 }
 
+// Finds candidate pairs for rows start, start + stride, ... Each row only
+// writes to its own list in rowPairs so rows can run in parallel.
 void *Grid::itterateOnStrip(int start, int size, int stride) {
-#pragma omp parallel for ordered schedule(dynamic) num_threads(8)
+#pragma omp parallel for schedule(dynamic) num_threads(numThreads)
     for (int i = start; i < start + size; i += stride) {
-        //Iterate over each row strip
-        unsigned int off = indices[i];
-        unsigned int next = tris.size();
-        if (i < indices.size() - 1) {
-            //This handles case of there is no next, so go to tris.size()
-            next = indices[i+1];
-        }
-        unsigned int nextNext = tris.size();
-        if (i < indices.size() - 2) {
-            //again handle case that next row is last row
-            nextNext = indices[i+2];
-        }
+        ProfileScope scope(profiler, PHASE_PAIRS);
+        stripRow(i);
+    }
+    return NULL;
+}
+
+// Pairs of row i into rowPairs[i]
+void Grid::stripRow(int i) {
+    unsigned int count = bodies.size();
+    std::vector<BodyPair> &out = rowPairs[i];
+    out.clear();
+    if (skipSleepingRows && !rowAwake[i] &&
+        (i + 1 == (int)indices.size() || !rowAwake[i + 1])) {
+        rowTests[i] = 0;
+        return;
+    }
+    unsigned long long tests = 0;
+    BodyPair pair;
+    //Iterate over each row strip
+    unsigned int off = indices[i];
+    unsigned int next = count;
+    if (i < indices.size() - 1) {
+        //This handles case of there is no next, so go to count
+        next = indices[i+1];
+    }
+    unsigned int nextNext = count;
+    if (i < indices.size() - 2) {
+        //again handle case that next row is last row
+        nextNext = indices[i+2];
+    }
 
-        int ownRowLow = off;
-        float orlMid;
-        if (off != tris.size()) {
-            orlMid = tris.at(ownRowLow)->midPt()[0];
+    int ownRowLow = off;
+    float orlMid;
+    if (off != count) {
+        orlMid = bodies.midX[ownRowLow];
+    }
+    int nextRowLow;
+    float nrlMid;
+    if (next != count) {
+        nextRowLow = next;
+        nrlMid = bodies.midX[nextRowLow];
+    }
+
+    //Iterate over each triangle
+    for (unsigned int j = off; j < next; j++) {
+        float mid1 = bodies.midX[j];
+        pair.a = j;
+
+        while (orlMid < (mid1 - triSize)) {
+            ownRowLow++;
+            orlMid = bodies.midX[ownRowLow];
         }
-        int nextRowLow;
-        float nrlMid;
-        if (next != tris.size()) {
-            nextRowLow = next;
-            nrlMid = tris.at(nextRowLow)->midPt()[0];
+        //collide within own row
+        pair.isStatic = false;
+        tests += j - ownRowLow;
+        for (unsigned int k = ownRowLow; k < j; k++) {
+            if (bodies.aabbOverlap(j, bodies, k)) {
+                pair.b = k;
+                out.push_back(pair);
+            }
         }
 
-        //Iterate over each triangle
-        for (unsigned int j = off; j < next; j++) {
-            Triangle tr1 = *tris.at(j);
+        //Collide with statics
+        staticPairs(j, out);
 
-            while (orlMid < (tr1.midPt()[0] - triSize)) {
-                ownRowLow++;
-                orlMid = tris.at(ownRowLow)->midPt()[0];
-            }
-            //collide within own row
-            for (unsigned int k = ownRowLow; k < j; k++) {
-                Triangle tr2 = *tris.at(k);
-                if (tr1.collide(tr2)) {
-                    *tris[k] = tr2;
-                }
+        //collide with row below
+        if (i != indices.size() - 1) {
+            while (nrlMid < (mid1 - triSize)
+                   && nextRowLow < (count - 1)) {
+                nextRowLow++;
+                nrlMid = bodies.midX[nextRowLow];
             }
 
-            //Collide with statics
-            for (unsigned int k = 0; k < statics.size(); k++) {
-                Triangle tr2 = *statics.at(k);
-                if (tr1.collide(tr2)) {
-                    *statics[k] = tr2;
+            if (nextRowLow < (int)nextNext) {
+                tests += nextNext - nextRowLow;
+            }
+            for (unsigned int k = nextRowLow; k < nextNext; k++) {
+                if (bodies.aabbOverlap(j, bodies, k)) {
+                    pair.b = k;
+                    out.push_back(pair);
                 }
             }
+        }
+    }
+    rowTests[i] = tests;
+}
 
-            //collide with row below
-            if (i != indices.size() - 1) {
-                while (nrlMid < (tr1.midPt()[0] - triSize)
-                       && nextRowLow < (tris.size() - 1)) {
-                    nextRowLow++;
-                    nrlMid = tris.at(nextRowLow)->midPt()[0];
-                }
+// Collects pairs found by tree queries
+struct PairVisitor {
+    BodyStore *bodies;
+    std::vector<BodyPair> *out;
+    BodyPair pair;
+    unsigned long long tests;
 
-                for (unsigned int k = nextRowLow; k < nextNext; k++) {
-                    Triangle tr2 = *tris.at(k);
-                    if (tr1.collide(tr2)) {
-                        *tris[k] = tr2;
-                    }
-                }
-            }
-            *tris[j] = tr1;
+    void operator()(unsigned int b) {
+        if (pair.isStatic) {
+            // The static tree holds exact boxes, overlap is already known
+            pair.b = b;
+            out->push_back(pair);
+            return;
+        }
+        // Moving tree holds slots and queryBefore meets each pair once.
+        // The higher slot goes first as with the other broadphases.
+        tests++;
+        if (bodies->aabbOverlap(pair.a, *bodies, b)) {
+            BodyPair found = pair;
+            found.a = std::max(pair.a, b);
+            found.b = std::min(pair.a, b);
+            out->push_back(found);
         }
     }
-    return NULL;
+};
+
+void Grid::staticPairs(unsigned int slot, std::vector<BodyPair> &out) {
+    PairVisitor visit;
+    visit.bodies = &bodies;
+    visit.out = &out;
+    visit.pair.a = slot;
+    visit.pair.isStatic = true;
+    visit.tests = 0;
+    staticTree.query(bodies.minX[slot], bodies.minY[slot],
+                     bodies.maxX[slot], bodies.maxY[slot], visit);
 }
 
 // Simulate all triangles falling
+// Bodies rebuild their cache as they move, statics only when flagged
 void Grid::stepAll(float stepTime) {
-    for (unsigned int i = 0; i < tris.size(); i++) {
-        tris[i]->timeStep(stepTime);
+    ProfileScope scope(profiler, PHASE_INTEGRATE);
+    stepDelta = stepTime;
+    bodies.stepAll(stepTime);
+    bodies.refreshDirty();
+    refreshStatics();
+    if (broadphase == TREE_BROADPHASE) {
+        updateTree();
     }
 }
 
-//Timestep each triangle and insertSort into order
-void Grid::rebalance() {
+void Grid::refreshStatics(void) {
+    std::vector<unsigned int> moved = statics.dirtySlots;
+    statics.refreshDirty();
+    for (unsigned int i = 0; i < moved.size(); i++) {
+        unsigned int k = moved[i];
+        staticTree.update(staticLeaf[k], statics.minX[k], statics.minY[k],
+                          statics.maxX[k], statics.maxY[k]);
+    }
+}
+
+void Grid::updateTree(void) {
+    tree.reinserts = 0;
+    for (unsigned int i = 0; i < bodies.size(); i++) {
+        tree.update(treeLeaf[i], bodies.minX[i], bodies.minY[i],
+                    bodies.maxX[i], bodies.maxY[i]);
+    }
+}
+
+// Broadphase: fill pairs with every bounding box overlap
+void Grid::findPairs(void) {
+    pairs.clear();
+    unsigned int count = bodies.size();
     if (LINEAR) {
-        for (unsigned int j = 0; j < tris.size(); j++) {
-            Triangle tr1 = *tris.at(j);
+        BodyPair pair;
+        for (unsigned int j = 0; j < count; j++) {
+            pair.a = j;
             //collide with everyone less than you
+            pair.isStatic = false;
             for (unsigned int k = 0; k < j; k++) {
-                Triangle tr2 = *tris.at(k);
-                if (tr1.collide(tr2)) {
-                    *tris[k] = tr2;
+                if (bodies.aabbOverlap(j, bodies, k)) {
+                    pair.b = k;
+                    pairs.push_back(pair);
                 }
             }
             //collide with statics
-            for (unsigned int k = 0; k < statics.size(); k++) {
-                Triangle tr2 = *statics.at(k);
-                if (tr1.collide(tr2)) {
-                    *statics[k] = tr2;
+            staticPairs(j, pairs);
+        }
+        pairTests = (unsigned long long)count * (count - 1) / 2;
+        return;
+    }
+
+    beginPairs();
+    if (broadphase == STRIP_BROADPHASE) {
+        itterateOnStrip(0, indices.size(), 1);
+    } else {
+#pragma omp parallel for schedule(dynamic) num_threads(numThreads)
+        for (int c = 0; c < PAIR_CHUNKS; c++) {
+            pairItem(c);
+        }
+    }
+    endPairs();
+}
+
+// Builds whatever the broadphase needs before pairItem can run
+void Grid::beginPairs(void) {
+    ProfileScope scope(profiler, PHASE_PAIRS);
+    pairs.clear();
+    if (broadphase == STRIP_BROADPHASE) {
+        rowPairs.resize(indices.size());
+        rowTests.resize(indices.size());
+        skipSleepingRows = allowSleep && islands.sleepingCount > 0;
+        if (skipSleepingRows) {
+            findAwakeRows();
+        }
+        return;
+    }
+    if (broadphase == CELL_BROADPHASE) {
+        cells.build(bodies, triSize);
+    } else if (broadphase == SWEEP_BROADPHASE) {
+        // The sweep is incremental so it runs alone, statics are chunked
+        sweep.update(bodies);
+        pairs = sweep.pairs;
+    }
+    chunkPairs.resize(PAIR_CHUNKS);
+    chunkTests.resize(PAIR_CHUNKS);
+}
+
+// Rows for the strip, slot chunks for the others
+unsigned int Grid::pairItems(void) {
+    return broadphase == STRIP_BROADPHASE ? indices.size() : PAIR_CHUNKS;
+}
+
+// Pairs of one row or chunk, items run in any order and in parallel
+void Grid::pairItem(unsigned int item) {
+    ProfileScope scope(profiler, PHASE_PAIRS);
+    if (broadphase == STRIP_BROADPHASE) {
+        stripRow(item);
+        return;
+    }
+    unsigned int count = bodies.size();
+    unsigned int begin = (unsigned long long)count * item / PAIR_CHUNKS;
+    unsigned int end = (unsigned long long)count * (item + 1) / PAIR_CHUNKS;
+    chunkTests[item] = findChunkPairs(begin, end, chunkPairs[item]);
+}
+
+// Joins the per row or per chunk lists in order
+void Grid::endPairs(void) {
+    ProfileScope scope(profiler, PHASE_PAIRS);
+    if (broadphase == STRIP_BROADPHASE) {
+        pairTests = 0;
+        for (unsigned int i = 0; i < rowPairs.size(); i++) {
+            pairs.insert(pairs.end(), rowPairs[i].begin(), rowPairs[i].end());
+            pairTests += rowTests[i];
+        }
+    } else {
+        pairTests = broadphase == SWEEP_BROADPHASE ? sweep.tests : 0;
+        for (int c = 0; c < PAIR_CHUNKS; c++) {
+            pairs.insert(pairs.end(), chunkPairs[c].begin(),
+                         chunkPairs[c].end());
+            pairTests += chunkTests[c];
+        }
+    }
+    if (allowSleep) {
+        dropSleepingPairs();
+    }
+    if (deterministic) {
+        canonicalPairs();
+    }
+}
+
+void Grid::findAwakeRows(void) {
+    unsigned int rows = indices.size();
+    rowAwake.assign(rows, 0);
+    for (unsigned int r = 0; r < rows; r++) {
+        unsigned int end = r + 1 < rows ? indices[r + 1] : bodies.size();
+        for (unsigned int j = indices[r]; j < end; j++) {
+            if (!bodies.asleep[j] && bodies.invMass[j] != 0.0f) {
+                rowAwake[r] = 1;
+                break;
+            }
+        }
+    }
+}
+
+// Sleeping bodies do not move, so neither do pairs of two sleepers or of
+// a sleeper and a static
+void Grid::dropSleepingPairs(void) {
+    if (islands.sleepingCount == 0) {
+        return;
+    }
+    unsigned int kept = 0;
+    for (unsigned int p = 0; p < pairs.size(); p++) {
+        BodyPair &pair = pairs[p];
+        if (!bodies.asleep[pair.a] ||
+            (!pair.isStatic && !bodies.asleep[pair.b])) {
+            pairs[kept++] = pair;
+        }
+    }
+    pairs.resize(kept);
+}
+
+/*
+  Every broadphase finds the same set of pairs but lists them in its own
+  order, and which body of a pair is a depends on slots. Putting the
+  lower id in a and sorting by (a id, b id), with statics after every
+  moving body, fixes both the narrowphase inputs and the order forces
+  are added in, so the result depends only on the bodies.
+ */
+void Grid::canonicalPairs(void) {
+    int count = pairs.size();
+    unsigned int moving = bodies.size();
+    pairKeys.resize(count);
+    pairOrder.resize(count);
+    int team = teamThreads();
+#pragma omp parallel for schedule(static) num_threads(team)
+    for (int p = 0; p < count; p++) {
+        BodyPair &pair = pairs[p];
+        unsigned int idA = bodies.idOf[pair.a];
+        unsigned int idB;
+        if (pair.isStatic) {
+            idB = moving + statics.idOf[pair.b];
+        } else {
+            idB = bodies.idOf[pair.b];
+            if (idB < idA) {
+                std::swap(pair.a, pair.b);
+                std::swap(idA, idB);
+            }
+        }
+        pairKeys[p] = ((SortKey)idA << 32) | idB;
+        pairOrder[p] = p;
+    }
+    radixSortKeys(pairKeys, pairOrder, keyScratch, orderScratch, team);
+    pairScratch.resize(count);
+#pragma omp parallel for schedule(static) num_threads(team)
+    for (int p = 0; p < count; p++) {
+        pairScratch[p] = pairs[pairOrder[p]];
+    }
+    pairs.swap(pairScratch);
+}
+
+// Pairs of slots [begin, end) for the broadphases that are not split by
+// rows. Returns the number of moving bounding box tests.
+unsigned long long Grid::findChunkPairs(unsigned int begin, unsigned int end,
+                                        std::vector<BodyPair> &out) {
+    out.clear();
+    unsigned long long tests = 0;
+    if (broadphase == CELL_BROADPHASE) {
+        tests = cells.findPairs(bodies, out, begin, end);
+    } else if (broadphase == TREE_BROADPHASE) {
+        PairVisitor visit;
+        visit.bodies = &bodies;
+        visit.out = &out;
+        visit.pair.isStatic = false;
+        visit.tests = 0;
+        for (unsigned int j = begin; j < end; j++) {
+            // Other leaves are fattened, so the tight box finds them all
+            visit.pair.a = j;
+            tree.queryBefore(treeLeaf[j], bodies.minX[j], bodies.minY[j],
+                             bodies.maxX[j], bodies.maxY[j], visit);
+        }
+        tests = visit.tests;
+    }
+    for (unsigned int j = begin; j < end; j++) {
+        staticPairs(j, out);
+    }
+    return tests;
+}
+
+// Narrowphase every pair in place, writing results to contacts
+void Grid::narrowphase(void) {
+    beginNarrowphase();
+    int count = pairs.size();
+    if (!useCache && profiler != NULL && profiler->enabled) {
+        // Chunks big enough that timing them costs little
+        int chunks = (count + NARROW_GRAIN - 1) / NARROW_GRAIN;
+#pragma omp parallel for schedule(static) num_threads(numThreads)
+        for (int c = 0; c < chunks; c++) {
+            collideRangeTimed(c * NARROW_GRAIN,
+                              std::min(count, (c + 1) * NARROW_GRAIN));
+        }
+        return;
+    }
+    if (!useCache) {
+        int groups = (count + SIMD_LANES - 1) / SIMD_LANES;
+#pragma omp parallel for schedule(static) num_threads(numThreads)
+        for (int g = 0; g < groups; g++) {
+            collideRange(g * SIMD_LANES, std::min(count, (g + 1) * SIMD_LANES));
+        }
+        return;
+    }
+    long long earlyExits = 0;
+    long long reused = 0;
+    // The cache does SAT and clipping together, so each thread's share
+    // is one narrow span
+#pragma omp parallel num_threads(numThreads)
+    {
+        ProfileScope scope(profiler, PHASE_NARROW);
+#pragma omp for schedule(static) reduction(+:earlyExits,reused)
+        for (int p = 0; p < count; p++) {
+            int result = collideAt(p);
+            earlyExits += result == CACHE_EARLY_EXIT;
+            reused += result == CACHE_REUSED;
+        }
+    }
+    endNarrowphase(earlyExits, reused);
+}
+
+void Grid::beginNarrowphase(void) {
+    contacts.resize(pairs.size());
+    if (useCache) {
+        cache.lookup(pairs, bodies);
+    }
+}
+
+// Narrowphase of pairs[p] into contacts[p]. Returns how the pair cache
+// was used, CACHE_FULL when it is off.
+int Grid::collideAt(unsigned int p) {
+    BodyView a;
+    BodyView b;
+    BodyPair &pair = pairs[p];
+    bodies.gather(pair.a, a);
+    if (pair.isStatic) {
+        statics.gather(pair.b, b);
+    } else {
+        bodies.gather(pair.b, b);
+    }
+    if (!useCache) {
+        collidePair(a, b, contacts[p]);
+        return CACHE_FULL;
+    }
+    return cache.collide(a, b, bodies.idOf[pair.a], cache.slots[p],
+                         contacts[p]);
+}
+
+// Narrowphase of pairs [begin, end) without the cache, SIMD_LANES pairs
+// at a time
+void Grid::collideRange(unsigned int begin, unsigned int end) {
+    BodyView a[SIMD_LANES];
+    BodyView b[SIMD_LANES];
+    for (unsigned int p = begin; p < end; p += SIMD_LANES) {
+        int n = std::min(end - p, (unsigned int)SIMD_LANES);
+        for (int l = 0; l < n; l++) {
+            BodyPair &pair = pairs[p + l];
+            bodies.gather(pair.a, a[l]);
+            if (pair.isStatic) {
+                statics.gather(pair.b, b[l]);
+            } else {
+                bodies.gather(pair.b, b[l]);
+            }
+        }
+        collideBatch(a, b, n, &contacts[p]);
+    }
+}
+
+/*
+  Same results as collideRange, with every SAT test of the range done
+  before any clipping so the two are timed as a span each. At most
+  NARROW_GRAIN pairs at a time.
+ */
+void Grid::collideRangeTimed(unsigned int begin, unsigned int end) {
+    BodyView a[SIMD_LANES];
+    BodyView b[SIMD_LANES];
+    bool hit[NARROW_GRAIN];
+    glm::vec2 colVec[NARROW_GRAIN];
+    for (unsigned int first = begin; first < end; first += NARROW_GRAIN) {
+        unsigned int last = std::min(end, first + NARROW_GRAIN);
+        double start = Profiler::now();
+        for (unsigned int p = first; p < last; p += SIMD_LANES) {
+            int n = std::min(last - p, (unsigned int)SIMD_LANES);
+            for (int l = 0; l < n; l++) {
+                BodyPair &pair = pairs[p + l];
+                bodies.gather(pair.a, a[l]);
+                if (pair.isStatic) {
+                    statics.gather(pair.b, b[l]);
+                } else {
+                    bodies.gather(pair.b, b[l]);
                 }
             }
-            *tris[j] = tr1;
+            satBatch(a, b, n, &hit[p - first], &colVec[p - first]);
+        }
+        double split = Profiler::now();
+        unsigned long long hits = 0;
+        for (unsigned int p = first; p < last; p++) {
+            contacts[p].hit = false;
+            if (!hit[p - first]) {
+                continue;
+            }
+            hits++;
+            BodyPair &pair = pairs[p];
+            bodies.gather(pair.a, a[0]);
+            if (pair.isStatic) {
+                statics.gather(pair.b, b[0]);
+            } else {
+                bodies.gather(pair.b, b[0]);
+            }
+            contactFromSat(a[0], b[0], colVec[p - first], contacts[p]);
+        }
+        profiler->record(PHASE_SAT, start, split);
+        profiler->record(PHASE_CLIP, split, Profiler::now());
+        profiler->count(COUNT_SAT_HITS, hits);
+    }
+}
+
+void Grid::endNarrowphase(long long earlyExits, long long reused) {
+    if (useCache) {
+        // Pruning moves the entries, so count touching pairs first
+        if (profiler != NULL && profiler->enabled) {
+            unsigned long long touching = 0;
+            for (unsigned int p = 0; p < cache.slots.size(); p++) {
+                touching += cache.entries[cache.slots[p]].axis < 0;
+            }
+            profiler->count(COUNT_SAT_HITS, touching);
+        }
+        cache.earlyExits = earlyExits;
+        cache.reused = reused;
+        cache.prune();
+    }
+}
+
+// Apply the forces of every contact in pair order
+void Grid::applyContacts(void) {
+    if (numThreads > 1) {
+        applyContactsParallel();
+        return;
+    }
+    applyContactsSerial();
+}
+
+void Grid::scaleContacts(void) {
+    if (contactScale == 1.0f) {
+        return;
+    }
+    for (unsigned int p = 0; p < contacts.size(); p++) {
+        Contact &c = contacts[p];
+        if (c.hit) {
+            c.linForce *= contactScale;
+            c.rotA *= contactScale;
+            c.rotB *= contactScale;
+        }
+    }
+}
+
+void Grid::applyContactsSerial(void) {
+    for (unsigned int p = 0; p < pairs.size(); p++) {
+        Contact &c = contacts[p];
+        if (!c.hit) {
+            continue;
+        }
+        unsigned int a = pairs[p].a;
+        unsigned int b = pairs[p].b;
+        // dv = F * 1/m
+        float invA = bodies.invMass[a];
+        bodies.velX[a] += c.linForce[0] * invA;
+        bodies.velY[a] += c.linForce[1] * invA;
+        bodies.angVel[a] -= c.rotA * invA;
+        // statics have no inverse mass so there is nothing to apply
+        if (!pairs[p].isStatic) {
+            float invB = bodies.invMass[b];
+            bodies.velX[b] -= c.linForce[0] * invB;
+            bodies.velY[b] -= c.linForce[1] * invB;
+            bodies.angVel[b] -= c.rotB * invB;
+        }
+    }
+}
+
+/*
+  Same result as the serial loop, bit for bit, whatever the thread
+  count. Every side of every contact becomes an entry keyed by the slot
+  it pushes, and a stable sort groups them by slot while keeping pair
+  order. Each body then adds up its own entries, so no two threads
+  write to the same body and the sums happen in the serial order.
+ */
+void Grid::applyContactsParallel(void) {
+    int count = bodies.size();
+    int entries = 2 * pairs.size();
+    // Sides that push nothing sort after every real slot
+    SortKey none = count;
+    contactKeys.resize(entries);
+    contactOrder.resize(entries);
+#pragma omp parallel for schedule(static) num_threads(numThreads)
+    for (int p = 0; p < (int)pairs.size(); p++) {
+        bool hit = contacts[p].hit;
+        contactKeys[2 * p] = hit ? pairs[p].a : none;
+        contactKeys[2 * p + 1] =
+            hit && !pairs[p].isStatic ? pairs[p].b : none;
+        contactOrder[2 * p] = 2 * p;
+        contactOrder[2 * p + 1] = 2 * p + 1;
+    }
+    radixSortKeys(contactKeys, contactOrder, keyScratch, orderScratch,
+                  numThreads);
+
+    // Range of entries for each slot
+    contactFirst.assign(count, 0);
+    contactLast.assign(count, 0);
+#pragma omp parallel for schedule(static) num_threads(numThreads)
+    for (int i = 0; i < entries; i++) {
+        SortKey key = contactKeys[i];
+        if (key == none) {
+            continue;
+        }
+        if (i == 0 || contactKeys[i - 1] != key) {
+            contactFirst[key] = i;
+        }
+        if (i == entries - 1 || contactKeys[i + 1] != key) {
+            contactLast[key] = i + 1;
+        }
+    }
+
+#pragma omp parallel for schedule(static) num_threads(numThreads)
+    for (int slot = 0; slot < count; slot++) {
+        float inv = bodies.invMass[slot];
+        for (unsigned int i = contactFirst[slot]; i < contactLast[slot]; i++) {
+            unsigned int entry = contactOrder[i];
+            Contact &c = contacts[entry >> 1];
+            if ((entry & 1) == 0) {
+                bodies.velX[slot] += c.linForce[0] * inv;
+                bodies.velY[slot] += c.linForce[1] * inv;
+                bodies.angVel[slot] -= c.rotA * inv;
+            } else {
+                bodies.velX[slot] -= c.linForce[0] * inv;
+                bodies.velY[slot] -= c.linForce[1] * inv;
+                bodies.angVel[slot] -= c.rotB * inv;
+            }
+        }
+    }
+}
+
+//Collide all triangles together
+void Grid::rebalance() {
+    findPairs();
+    narrowphase();
+    resolveContacts();
+}
+
+void Grid::resolveContacts(void) {
+    ProfileScope scope(profiler, PHASE_RESPONSE);
+    if (allowSleep) {
+        islands.wake(bodies, pairs, contacts);
+    }
+    scaleContacts();
+    applyContacts();
+    if (allowSleep) {
+        islands.update(bodies, pairs, contacts, stepDelta);
+    }
+}
+
+/*
+  One substep: stepAll, initialSort and rebalance. With a pool the same
+  stages run as a task graph, chunked across the pool's workers, and
+  give the same result bit for bit.
+ */
+int Grid::teamThreads(void) {
+    return pool == NULL ? numThreads : 1;
+}
+
+void Grid::substep(float stepTime) {
+    bool profiling = profiler != NULL && profiler->enabled;
+    if (profiling) {
+        profiler->beginSubstep();
+    }
+    if (allowSleep && !statics.dirtySlots.empty()) {
+        islands.wakeAll(bodies);
+    }
+    if (allowSleep && bodies.moving.empty()) {
+        // Everything is asleep and nothing can wake it
+        pairs.clear();
+        contacts.clear();
+        pairTests = 0;
+        sortMoves = 0;
+        sortUsedRadix = false;
+    } else if (pool == NULL) {
+        stepAll(stepTime);
+        initialSort();
+        rebalance();
+    } else {
+        if (stepGraph.tasks.empty()) {
+            buildStepGraph();
+        }
+        stepDelta = stepTime;
+        pool->run(stepGraph);
+    }
+    if (profiling) {
+        countSubstep();
+        profiler->endSubstep();
+    }
+}
+
+// Counters the stages keep anyway, added once the substep is done. SAT
+// hits are counted by collideRangeTimed or endNarrowphase.
+void Grid::countSubstep(void) {
+    unsigned long long hits = 0;
+    for (unsigned int p = 0; p < contacts.size(); p++) {
+        hits += contacts[p].hit;
+    }
+    profiler->count(COUNT_CANDIDATES, pairTests);
+    profiler->count(COUNT_AABB_HITS, pairs.size());
+    profiler->count(COUNT_CONTACTS, hits);
+    profiler->count(COUNT_SORT_SWAPS, sortMoves);
+}
+
+// Task bodies for the step graph, data is the Grid
+
+static void integrateTask(void *data, unsigned int begin, unsigned int end) {
+    Grid *gr = (Grid *)data;
+    ProfileScope scope(gr->profiler, PHASE_INTEGRATE);
+    gr->bodies.stepRange(begin, end, gr->stepDelta);
+}
+
+static unsigned int movingCount(void *data) {
+    return ((Grid *)data)->bodies.moving.size();
+}
+
+static void staticsTask(void *data, unsigned int, unsigned int) {
+    Grid *gr = (Grid *)data;
+    ProfileScope scope(gr->profiler, PHASE_INTEGRATE);
+    gr->refreshStatics();
+}
+
+static void boundsTask(void *data, unsigned int, unsigned int) {
+    Grid *gr = (Grid *)data;
+    ProfileScope scope(gr->profiler, PHASE_SORT);
+    gr->bodies.refreshDirty();
+    if (gr->broadphase == TREE_BROADPHASE) {
+        gr->updateTree();
+    }
+    gr->findBounds();
+    gr->keys.resize(gr->bodies.size());
+    gr->order.resize(gr->bodies.size());
+}
+
+// Sweep and prune and the tree keep bodies in place, no keys to sort
+static unsigned int keyCount(void *data) {
+    Grid *gr = (Grid *)data;
+    if (gr->keepsSlots()) {
+        return 0;
+    }
+    return gr->bodies.size();
+}
+
+static void keysTask(void *data, unsigned int begin, unsigned int end) {
+    Grid *gr = (Grid *)data;
+    ProfileScope scope(gr->profiler, PHASE_SORT);
+    for (unsigned int i = begin; i < end; i++) {
+        gr->setKey(i);
+    }
+}
+
+static void sortTask(void *data, unsigned int, unsigned int) {
+    Grid *gr = (Grid *)data;
+    if (!gr->keepsSlots() && gr->bodies.size() > 0) {
+        ProfileScope scope(gr->profiler, PHASE_SORT);
+        gr->sortKeys();
+    }
+    gr->beginPairs();
+}
+
+static unsigned int pairItemCount(void *data) {
+    return ((Grid *)data)->pairItems();
+}
+
+static void pairsTask(void *data, unsigned int begin, unsigned int end) {
+    Grid *gr = (Grid *)data;
+    for (unsigned int i = begin; i < end; i++) {
+        gr->pairItem(i);
+    }
+}
+
+static void gatherTask(void *data, unsigned int, unsigned int) {
+    Grid *gr = (Grid *)data;
+    gr->endPairs();
+    gr->beginNarrowphase();
+    unsigned int chunks = gr->pairs.size() / NARROW_GRAIN + 1;
+    gr->narrowEarly.assign(chunks, 0);
+    gr->narrowReused.assign(chunks, 0);
+}
+
+static unsigned int pairCount(void *data) {
+    return ((Grid *)data)->pairs.size();
+}
+
+static void narrowTask(void *data, unsigned int begin, unsigned int end) {
+    Grid *gr = (Grid *)data;
+    if (!gr->useCache) {
+        if (gr->profiler != NULL && gr->profiler->enabled) {
+            gr->collideRangeTimed(begin, end);
+        } else {
+            gr->collideRange(begin, end);
         }
         return;
     }
+    ProfileScope scope(gr->profiler, PHASE_NARROW);
+    long long earlyExits = 0;
+    long long reused = 0;
+    for (unsigned int p = begin; p < end; p++) {
+        int result = gr->collideAt(p);
+        earlyExits += result == CACHE_EARLY_EXIT;
+        reused += result == CACHE_REUSED;
+    }
+    gr->narrowEarly[begin / NARROW_GRAIN] = earlyExits;
+    gr->narrowReused[begin / NARROW_GRAIN] = reused;
+}
+
+static void applyTask(void *data, unsigned int, unsigned int) {
+    Grid *gr = (Grid *)data;
+    long long earlyExits = 0;
+    long long reused = 0;
+    for (unsigned int c = 0; c < gr->narrowEarly.size(); c++) {
+        earlyExits += gr->narrowEarly[c];
+        reused += gr->narrowReused[c];
+    }
+    gr->endNarrowphase(earlyExits, reused);
+    ProfileScope scope(gr->profiler, PHASE_RESPONSE);
+    if (gr->allowSleep) {
+        gr->islands.wake(gr->bodies, gr->pairs, gr->contacts);
+    }
+    gr->scaleContacts();
+    gr->applyContactsSerial();
+    if (gr->allowSleep) {
+        gr->islands.update(gr->bodies, gr->pairs, gr->contacts,
+                           gr->stepDelta);
+    }
+}
 
-    // single thread version
-    itterateOnStrip(0, indices.size(), 2);
-    itterateOnStrip(1, indices.size() - 1, 2);
-
-    // int size = indices.size() / NUMTHREADS;
-    // pthread_t tid[NUMTHREADS];
-    // //contains int of start, then int of length
-    // PThreadInfo thrd_info[NUMTHREADS];
-    // for (int i = 0; i < NUMTHREADS; i++) {
-    //     thrd_info[i].start = i * size;
-    //     if (i == 7) {
-    //         size = indices.size() - (size * 7);
-    //     }
-    //     thrd_info[i].size = size;
-    //     thrd_info[i].grid = this;
-    //     thrd_info[i].stride = 2;
-    //     pthread_create(&tid[i], 0, &Grid::pThreadStrip, (void*)&thrd_info[i]);
-    // }
-
-    // for (int i = 0; i < NUMTHREADS; i++) {
-    //     pthread_join(tid[i], NULL);
-    // }
-
-    // size = (indices.size() - 1) / NUMTHREADS;
-
-    // for (int i = 1; i < NUMTHREADS; i++) {
-    //     thrd_info[i].start = i * size;
-    //     if (i == 7) {
-    //         size = indices.size() - (size * 7) - 1;
-    //     }
-    //     thrd_info[i].size = size;
-    //     thrd_info[i].grid = this;
-    //     thrd_info[i].stride = 2;
-    //     pthread_create(&tid[i], 0, &Grid::pThreadStrip, (void*)&thrd_info[i]);
-    // }
-
-    // for (int i = 0; i < NUMTHREADS; i++) {
-    //     pthread_join(tid[i], NULL);
-    // }
-
-// #pragma omp parallel for ordered schedule(dynamic) num_threads(2)
-//     for (int i = 0; i < indices.size(); i += 2) {
-//         itterateOnStrip(i);
-//     }
-
-// #pragma omp parallel for ordered schedule(dynamic) num_threads(2)
-//     for (int i = 1; i < indices.size(); i += 2) {
-//         itterateOnStrip(i);
-//     }
+/*
+  integrate -> bounds -> keys -> sort -> pairs -> gather -> narrow -> apply
+  with statics refreshed alongside integration, ahead of the sort.
+  Tasks with a count are split into chunks of their grain.
+ */
+void Grid::buildStepGraph(void) {
+    TaskGraph &g = stepGraph;
+    int integrate = g.add("integrate", integrateTask, movingCount, this, 2048);
+    int stats = g.add("statics", staticsTask, NULL, this, 1);
+    int bounds = g.add("bounds", boundsTask, NULL, this, 1);
+    int keys = g.add("keys", keysTask, keyCount, this, 4096);
+    int sort = g.add("sort", sortTask, NULL, this, 1);
+    int pairs = g.add("pairs", pairsTask, pairItemCount, this, 1);
+    int gather = g.add("gather", gatherTask, NULL, this, 1);
+    int narrow = g.add("narrow", narrowTask, pairCount, this, NARROW_GRAIN);
+    int apply = g.add("apply", applyTask, NULL, this, 1);
+    g.depend(bounds, integrate);
+    g.depend(keys, bounds);
+    g.depend(sort, keys);
+    g.depend(sort, stats);
+    g.depend(pairs, sort);
+    g.depend(gather, pairs);
+    g.depend(narrow, gather);
+    g.depend(apply, narrow);
 }
 
 void Grid::print(void) {
@@ -279,11 +1009,10 @@ void Grid::print(void) {
         if (i != indices.size() - 1) {
             next = indices[i+1];
         } else {
-            next = tris.size();
+            next = bodies.size();
         }
         for (unsigned int j = off; j < next; j++) {
-            glm::vec2 mid = tris[j]->midPt();
-            std::cout << "(" << mid[0] << " " << mid[1] << ") ";
+            std::cout << "(" << bodies.midX[j] << " " << bodies.midY[j] << ") ";
         }
         std::cout << "\n";
     }
@@ -5,40 +5,191 @@
 #include <glm.hpp>
 
 #include "triangle.hpp"
+#include "bodyStore.hpp"
+#include "keySort.hpp"
+#include "cellGrid.hpp"
+#include "aabbTree.hpp"
+#include "sweepPrune.hpp"
+#include "pairCache.hpp"
+#include "taskPool.hpp"
+#include "profiler.hpp"
+#include "islands.hpp"
+
+// How Grid finds candidate pairs, picked when it is built
+enum BroadphaseType {
+    // Sweep x within horizontal rows of height triSize
+    STRIP_BROADPHASE,
+    // Hashed uniform grid of triSize cells
+    CELL_BROADPHASE,
+    // Dynamic tree of fattened boxes, any body size. Bodies keep their
+    // slots. Slower than the others on bodies of one size; it only pays
+    // off when sizes are mixed and strip and cell miss pairs.
+    TREE_BROADPHASE,
+    // Persistent sorted box ends on x and y. Bodies keep their slots.
+    SWEEP_BROADPHASE
+};
 
 class Grid {
 public:
 
-    // Underlying vector of triangles that move
-    std::vector<Triangle *> tris;
+    // Triangles that move, kept in spatial order
+    BodyStore bodies;
     // Special triangles - large
-    std::vector<Triangle *> statics;
+    BodyStore statics;
     // Max width of a triangle
     float triSize;
+    BroadphaseType broadphase;
+    // Only used by CELL_BROADPHASE
+    CellGrid cells;
+    // Only used by TREE_BROADPHASE, leaves hold body slots
+    AabbTree tree;
+    std::vector<int> treeLeaf;
+    // Only used by SWEEP_BROADPHASE
+    SweepPrune sweep;
+    // Statics, queried once per moving body whatever the broadphase.
+    // Leaves hold static slots.
+    AabbTree staticTree;
+    std::vector<int> staticLeaf;
 
+    // First slot of each row
     std::vector<unsigned int> indices;
+    // (row, x) key per slot and the slot permutation sorted along with
+    // them, applied to bodies afterwards
+    std::vector<SortKey> keys;
+    std::vector<unsigned int> order;
+    std::vector<SortKey> keyScratch;
+    std::vector<unsigned int> orderScratch;
+    bool sortedOnce;
+    // Element shifts done by the last sort, and whether it used radix
+    unsigned long long sortMoves;
+    bool sortUsedRadix;
+
+    // Threads used by each parallel stage
+    int numThreads;
+    // If set, substep runs stepGraph on it instead of OpenMP. Not owned.
+    TaskPool *pool;
+    // The stages of substep as tasks, with their timings
+    TaskGraph stepGraph;
+    float stepDelta;
+    // If set, substep records phase timings and counters into it. Not
+    // owned.
+    Profiler *profiler;
+    // Pair cache counters per narrowphase chunk of stepGraph
+    std::vector<long long> narrowEarly;
+    std::vector<long long> narrowReused;
+
+    // Candidate pairs from the broadphase, per row or per chunk of slots
+    // and then all together
+    std::vector<std::vector<BodyPair> > rowPairs;
+    std::vector<std::vector<BodyPair> > chunkPairs;
+    std::vector<unsigned long long> chunkTests;
+    std::vector<BodyPair> pairs;
+    // If set, pairs are put in body id order, the lower id first, so the
+    // result does not depend on the broadphase or on slot order
+    bool deterministic;
+    std::vector<SortKey> pairKeys;
+    std::vector<unsigned int> pairOrder;
+    std::vector<BodyPair> pairScratch;
+    // Narrowphase result for each entry of pairs
+    std::vector<Contact> contacts;
+    // Separating axes and contacts carried between substeps, used by
+    // narrowphase if useCache is set
+    PairCache cache;
+    bool useCache;
+    // Contact sides grouped by the slot they push, and the range of
+    // each slot, for applyContactsParallel
+    std::vector<SortKey> contactKeys;
+    std::vector<unsigned int> contactOrder;
+    std::vector<unsigned int> contactFirst;
+    std::vector<unsigned int> contactLast;
+    // Contact forces are impulses given once a substep, sized for steps
+    // of 0.0005. Substeps of another length scale them by this.
+    float contactScale;
+    // If set, resting islands of bodies go to sleep
+    bool allowSleep;
+    Islands islands;
+    // Whether each row has an awake body, while some are asleep. Rows
+    // with none in them or the row below find no pairs.
+    std::vector<unsigned char> rowAwake;
+    bool skipSleepingRows;
+    // Moving body bounding box tests done by the last findPairs, in total
+    // and per row
+    unsigned long long pairTests;
+    std::vector<unsigned long long> rowTests;
 
     //Highest and lowest positions of triangles
     float high;
     float low;
 
-    Grid(std::vector<Triangle> &trs, std::vector<Triangle> &stats, float trSize);
+    Grid(std::vector<Triangle> &trs, std::vector<Triangle> &stats, float trSize,
+         BroadphaseType type = STRIP_BROADPHASE);
 
-    //quickSort over all triangles
-    void initialSort(void);
+    // stepAll, initialSort and rebalance, on pool if there is one
+    void substep(float stepTime);
+    void buildStepGraph(void);
 
-    bool compare(Triangle *t1, Triangle *t2);
-    int partition(unsigned int left, unsigned int right, unsigned int pivot);
-    void quicksort(unsigned int left, unsigned int right);
+    //Sort all triangles into rows
+    void initialSort(void);
+    // True if the broadphase leaves bodies unsorted
+    bool keepsSlots(void);
+    // Stages of initialSort
+    void findBounds(void);
+    void computeKeys(void);
+    void setKey(unsigned int i);
+    void sortKeys(void);
 
     //Timestep over all triangles and simulate forces
     void stepAll(float stepTime);
+    // Rebuild caches of flagged statics and move their leaves
+    void refreshStatics(void);
+    // Reinsert moving bodies that left their fattened boxes
+    void updateTree(void);
     //Collide all triangles together
     void rebalance(void);
+    // The three stages of rebalance
+    void findPairs(void);
+    // Stages of findPairs. pairItem may run in parallel for each of the
+    // pairItems() items
+    void beginPairs(void);
+    unsigned int pairItems(void);
+    void pairItem(unsigned int item);
+    void endPairs(void);
+    // Orders pairs for deterministic mode
+    void canonicalPairs(void);
+    // Drops pairs with no awake body in them
+    void dropSleepingPairs(void);
+    // Fills rowAwake
+    void findAwakeRows(void);
+    unsigned long long findChunkPairs(unsigned int begin, unsigned int end,
+                                      std::vector<BodyPair> &out);
+    // Statics are tested against every moving body
+    void staticPairs(unsigned int slot, std::vector<BodyPair> &out);
+    void narrowphase(void);
+    // Stages of narrowphase, collideAt may run in parallel
+    void beginNarrowphase(void);
+    int collideAt(unsigned int p);
+    void collideRange(unsigned int begin, unsigned int end);
+    // collideRange with SAT and clipping timed apart
+    void collideRangeTimed(unsigned int begin, unsigned int end);
+    void endNarrowphase(long long earlyExits, long long reused);
+    // Multiplies the hit contacts by contactScale
+    void scaleContacts(void);
+    void applyContacts(void);
+    void applyContactsSerial(void);
+    void applyContactsParallel(void);
+    // Wakes touched sleepers, applies the contacts and puts resting
+    // islands to sleep
+    void resolveContacts(void);
+    // Substep counters for the profiler
+    void countSubstep(void);
+    // OpenMP team size for stages shared by both paths: numThreads, or 1
+    // on the pool, whose tasks must not start teams of their own
+    int teamThreads(void);
 
     static void *pThreadStrip(void * input);
-    //Iterate over strips and do collisions
+    //Iterate over strips and find candidate pairs
     void *itterateOnStrip(int start, int size, int stride);
+    void stripRow(int i);
 
     void print(void);
 
@@ -0,0 +1,198 @@
+#include "islands.hpp"
+
+#include <math.h>
+#include <cfloat>
+
+Islands::Islands(void) {
+    sleepSpeed = 2.0f;
+    sleepSpin = 30.0f;
+    sleepTime = 1.0f;
+    islandCount = 0;
+    sleepingCount = 0;
+    slept = 0;
+    woken = 0;
+}
+
+void Islands::resize(BodyStore &bodies) {
+    unsigned int count = bodies.size();
+    if (parent.size() == count) {
+        return;
+    }
+    parent.resize(count);
+    restTime.resize(count);
+    anchorX.resize(count);
+    anchorY.resize(count);
+    anchorAngle.resize(count);
+    islandRest.resize(count);
+    label.resize(count);
+    wakeLabel.assign(count, 0);
+    for (unsigned int slot = 0; slot < count; slot++) {
+        restFrom(bodies, slot, 0.0f);
+    }
+}
+
+void Islands::restFrom(BodyStore &bodies, unsigned int slot, float time) {
+    unsigned int id = bodies.idOf[slot];
+    restTime[id] = time;
+    anchorX[id] = bodies.midX[slot];
+    anchorY[id] = bodies.midY[slot];
+    anchorAngle[id] = bodies.angle[slot];
+}
+
+// Root of id's island, halving the path on the way up
+unsigned int Islands::find(unsigned int id) {
+    while (parent[id] != id) {
+        parent[id] = parent[parent[id]];
+        id = parent[id];
+    }
+    return id;
+}
+
+// The lower root wins so islands come out the same every run
+void Islands::unite(unsigned int a, unsigned int b) {
+    a = find(a);
+    b = find(b);
+    if (a < b) {
+        parent[b] = a;
+    } else if (b < a) {
+        parent[a] = b;
+    }
+}
+
+void Islands::wake(BodyStore &bodies, const std::vector<BodyPair> &pairs,
+                   const std::vector<Contact> &contacts) {
+    woken = 0;
+    if (sleepingCount == 0) {
+        return;
+    }
+    resize(bodies);
+    bool any = false;
+    float active = sleepTime * 0.5f;
+    for (unsigned int p = 0; p < pairs.size(); p++) {
+        const BodyPair &pair = pairs[p];
+        if (!contacts[p].hit || pair.isStatic ||
+            bodies.asleep[pair.a] == bodies.asleep[pair.b]) {
+            continue;
+        }
+        unsigned int sleeper = bodies.asleep[pair.a] ? pair.a : pair.b;
+        unsigned int waker = sleeper == pair.a ? pair.b : pair.a;
+        if (restTime[bodies.idOf[waker]] < active) {
+            wakeLabel[label[bodies.idOf[sleeper]]] = 1;
+            any = true;
+        }
+    }
+    if (!any) {
+        return;
+    }
+    for (unsigned int slot = 0; slot < bodies.size(); slot++) {
+        unsigned int id = bodies.idOf[slot];
+        if (bodies.asleep[slot] && wakeLabel[label[id]]) {
+            // Half rested, so they only wake others once they move
+            bodies.asleep[slot] = 0;
+            restFrom(bodies, slot, active);
+            woken++;
+        }
+    }
+    for (unsigned int id = 0; id < wakeLabel.size(); id++) {
+        wakeLabel[id] = 0;
+    }
+    sleepingCount -= woken;
+    bodies.findMoving();
+}
+
+void Islands::wakeAll(BodyStore &bodies) {
+    woken = 0;
+    if (sleepingCount == 0) {
+        return;
+    }
+    resize(bodies);
+    for (unsigned int slot = 0; slot < bodies.size(); slot++) {
+        if (bodies.asleep[slot]) {
+            bodies.asleep[slot] = 0;
+            restFrom(bodies, slot, 0.0f);
+            woken++;
+        }
+    }
+    sleepingCount = 0;
+    bodies.findMoving();
+}
+
+/*
+  Sleepers only touch awake bodies through contacts that did not wake
+  them. They hold still like statics, so the forces those contacts put
+  on them are dropped, and they join no island.
+ */
+void Islands::update(BodyStore &bodies, const std::vector<BodyPair> &pairs,
+                     const std::vector<Contact> &contacts, float delta) {
+    slept = 0;
+    resize(bodies);
+    const std::vector<unsigned int> &moving = bodies.moving;
+    for (unsigned int i = 0; i < moving.size(); i++) {
+        unsigned int id = bodies.idOf[moving[i]];
+        parent[id] = id;
+        islandRest[id] = FLT_MAX;
+    }
+    for (unsigned int p = 0; p < pairs.size(); p++) {
+        const BodyPair &pair = pairs[p];
+        if (!contacts[p].hit || pair.isStatic) {
+            continue;
+        }
+        unsigned int sleeper = bodies.asleep[pair.a] ? pair.a :
+            bodies.asleep[pair.b] ? pair.b : bodies.size();
+        if (sleeper < bodies.size()) {
+            bodies.velX[sleeper] = 0.0f;
+            bodies.velY[sleeper] = 0.0f;
+            bodies.angVel[sleeper] = 0.0f;
+        } else {
+            unite(bodies.idOf[pair.a], bodies.idOf[pair.b]);
+        }
+    }
+
+    float reach = sleepSpeed * sleepTime;
+    float turn = sleepSpin * sleepTime;
+    for (unsigned int i = 0; i < moving.size(); i++) {
+        unsigned int slot = moving[i];
+        unsigned int id = bodies.idOf[slot];
+        float dx = bodies.midX[slot] - anchorX[id];
+        float dy = bodies.midY[slot] - anchorY[id];
+        float da = fabs(bodies.angle[slot] - anchorAngle[id]);
+        if (da > 180.0f) {
+            da = 360.0f - da;
+        }
+        if (dx * dx + dy * dy > reach * reach || da > turn) {
+            restFrom(bodies, slot, 0.0f);
+        } else {
+            restTime[id] += delta;
+        }
+        unsigned int root = find(id);
+        if (restTime[id] < islandRest[root]) {
+            islandRest[root] = restTime[id];
+        }
+    }
+
+    islandCount = 0;
+    toSleep.clear();
+    for (unsigned int i = 0; i < moving.size(); i++) {
+        unsigned int slot = moving[i];
+        unsigned int id = bodies.idOf[slot];
+        unsigned int root = find(id);
+        islandCount += root == id;
+        if (islandRest[root] >= sleepTime) {
+            toSleep.push_back(slot);
+            label[id] = root;
+        }
+    }
+    if (toSleep.empty()) {
+        return;
+    }
+    for (unsigned int i = 0; i < toSleep.size(); i++) {
+        unsigned int slot = toSleep[i];
+        bodies.asleep[slot] = 1;
+        bodies.velX[slot] = 0.0f;
+        bodies.velY[slot] = 0.0f;
+        bodies.angVel[slot] = 0.0f;
+    }
+    slept = toSleep.size();
+    sleepingCount += slept;
+    bodies.findMoving();
+}
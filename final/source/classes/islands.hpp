@@ -0,0 +1,79 @@
+#ifndef __ISLANDS_H
+#define __ISLANDS_H
+
+#include <vector>
+
+#include "bodyStore.hpp"
+#include "narrowphase.hpp"
+
+/*
+  Sleeping for bodies at rest. Spring contacts keep resting bodies
+  jiggling, so a body counts as resting while it stays close to where
+  its rest began: within sleepSpeed * sleepTime of that position and
+  sleepSpin * sleepTime of that angle, an average speed below the
+  thresholds. Each substep the awake bodies that touched are joined
+  into islands by a union-find over the contacts, and an island goes to
+  sleep once every body in it has rested for sleepTime.
+
+  Sleeping bodies have their velocities zeroed and leave
+  BodyStore::moving, so they are not integrated, and Grid drops pairs
+  without an awake body before the narrowphase. Until woken they hold
+  still like statics, so a pile settles from the bottom up. A contact
+  from an awake body that has not rested for half of sleepTime wakes
+  the whole island the sleeper went to sleep with. Statics never join an
+  island. Everything here is kept by body id, so it survives Grid's
+  sorts.
+ */
+class Islands {
+public:
+    // Average speeds below which a body counts as resting. Spin is in
+    // degrees a second.
+    float sleepSpeed;
+    float sleepSpin;
+    // Seconds every body of an island must rest before it sleeps
+    float sleepTime;
+
+    // Islands of awake bodies found by the last update
+    unsigned int islandCount;
+    unsigned int sleepingCount;
+    // Bodies put to sleep and woken during the last substep
+    unsigned int slept;
+    unsigned int woken;
+
+    Islands(void);
+
+    // Wakes the islands of sleeping bodies in contact with awake ones.
+    // Call after the narrowphase and before the contacts are applied.
+    void wake(BodyStore &bodies, const std::vector<BodyPair> &pairs,
+              const std::vector<Contact> &contacts);
+    void wakeAll(BodyStore &bodies);
+    // Builds the islands of this substep's contacts, moves the rest
+    // timers on by delta and puts resting islands to sleep
+    void update(BodyStore &bodies, const std::vector<BodyPair> &pairs,
+                const std::vector<Contact> &contacts, float delta);
+
+private:
+    // Union-find forest over ids, only meaningful for awake bodies
+    std::vector<unsigned int> parent;
+    // Time each body has been resting, where the rest began, and the
+    // least rest of an island's bodies at its root
+    std::vector<float> restTime;
+    std::vector<float> anchorX;
+    std::vector<float> anchorY;
+    std::vector<float> anchorAngle;
+    std::vector<float> islandRest;
+    // Root of the island a sleeping body went to sleep in
+    std::vector<unsigned int> label;
+    // Labels to wake, indexed by label
+    std::vector<unsigned char> wakeLabel;
+    std::vector<unsigned int> toSleep;
+
+    // Sizes everything for bodies, every rest starting where it is
+    void resize(BodyStore &bodies);
+    // Starts slot's rest over from where it is, already rested for time
+    void restFrom(BodyStore &bodies, unsigned int slot, float time);
+    unsigned int find(unsigned int id);
+    void unite(unsigned int a, unsigned int b);
+};
+
+#endif
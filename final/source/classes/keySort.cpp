@@ -0,0 +1,118 @@
+#include "keySort.hpp"
+
+#include <cstring>
+
+unsigned int floatKey(float f) {
+    unsigned int bits;
+    memcpy(&bits, &f, sizeof(bits));
+    // Negative floats sort backwards, so flip all their bits. Positive
+    // ones just need to land above the negatives.
+    if (bits & 0x80000000u) {
+        return ~bits;
+    }
+    return bits | 0x80000000u;
+}
+
+SortKey makeKey(int row, float x) {
+    return ((SortKey)(unsigned int)row << 32) | floatKey(x);
+}
+
+bool insertionSortKeys(std::vector<SortKey> &keys,
+                       std::vector<unsigned int> &order,
+                       unsigned long long maxMoves,
+                       unsigned long long &moves) {
+    moves = 0;
+    unsigned int count = keys.size();
+    for (unsigned int i = 1; i < count; i++) {
+        SortKey key = keys[i];
+        if (keys[i - 1] <= key) {
+            continue;
+        }
+        unsigned int slot = order[i];
+        unsigned int j = i;
+        while (j > 0 && keys[j - 1] > key) {
+            keys[j] = keys[j - 1];
+            order[j] = order[j - 1];
+            j--;
+        }
+        keys[j] = key;
+        order[j] = slot;
+        moves += i - j;
+        if (moves > maxMoves) {
+            return false;
+        }
+    }
+    return true;
+}
+
+int radixSortKeys(std::vector<SortKey> &keys, std::vector<unsigned int> &order,
+                  std::vector<SortKey> &keyScratch,
+                  std::vector<unsigned int> &orderScratch, int threads) {
+    int count = keys.size();
+    keyScratch.resize(count);
+    orderScratch.resize(count);
+    // A stable LSD sort has only one possible output, so the chunk count
+    // only changes how the work is split, never the result
+    int chunks = threads > 1 ? threads : 1;
+    if (count < 4096 * chunks) {
+        chunks = count / 4096 + 1;
+    }
+    std::vector<unsigned int> hist(chunks * 256);
+    int passes = 0;
+
+    for (int shift = 0; shift < 64; shift += 8) {
+        memset(&hist[0], 0, hist.size() * sizeof(unsigned int));
+#pragma omp parallel for schedule(static, 1) num_threads(chunks)
+        for (int c = 0; c < chunks; c++) {
+            unsigned int *h = &hist[c * 256];
+            int beg = (int)((long long)count * c / chunks);
+            int end = (int)((long long)count * (c + 1) / chunks);
+            for (int i = beg; i < end; i++) {
+                h[(keys[i] >> shift) & 0xff]++;
+            }
+        }
+
+        // Skip digits every key shares, common for the row bits
+        bool constant = false;
+        for (int d = 0; d < 256 && !constant; d++) {
+            unsigned int total = 0;
+            for (int c = 0; c < chunks; c++) {
+                total += hist[c * 256 + d];
+            }
+            if (total == (unsigned int)count) {
+                constant = true;
+            } else if (total != 0) {
+                break;
+            }
+        }
+        if (constant) {
+            continue;
+        }
+
+        // Exclusive prefix, digit major then chunk, keeps it stable
+        unsigned int sum = 0;
+        for (int d = 0; d < 256; d++) {
+            for (int c = 0; c < chunks; c++) {
+                unsigned int n = hist[c * 256 + d];
+                hist[c * 256 + d] = sum;
+                sum += n;
+            }
+        }
+
+#pragma omp parallel for schedule(static, 1) num_threads(chunks)
+        for (int c = 0; c < chunks; c++) {
+            unsigned int *h = &hist[c * 256];
+            int beg = (int)((long long)count * c / chunks);
+            int end = (int)((long long)count * (c + 1) / chunks);
+            for (int i = beg; i < end; i++) {
+                unsigned int dst = h[(keys[i] >> shift) & 0xff]++;
+                keyScratch[dst] = keys[i];
+                orderScratch[dst] = order[i];
+            }
+        }
+        keys.swap(keyScratch);
+        order.swap(orderScratch);
+        passes++;
+    }
+    return passes;
+}
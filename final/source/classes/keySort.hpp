@@ -0,0 +1,36 @@
+#ifndef __KEYSORT_H
+#define __KEYSORT_H
+
+#include <vector>
+
+// 64 bit spatial sort key: row in the high word, x in the low word
+typedef unsigned long long SortKey;
+
+// Order preserving map from a float to an unsigned int
+unsigned int floatKey(float f);
+SortKey makeKey(int row, float x);
+inline int keyRow(SortKey key) {
+    return (int)(key >> 32);
+}
+
+/*
+  Stable sorts of keys that carry order (a slot list) along with them.
+ */
+
+// Insertion sort for nearly sorted input. Gives up once more than
+// maxMoves elements have been shifted and returns false; keys and order
+// are left as a valid, partly sorted permutation. moves gets the number
+// of element shifts done.
+bool insertionSortKeys(std::vector<SortKey> &keys,
+                       std::vector<unsigned int> &order,
+                       unsigned long long maxMoves,
+                       unsigned long long &moves);
+
+// LSD radix sort, 8 bits per pass, passes over constant digits skipped.
+// Each pass counts and scatters in a chunk per thread, on up to threads
+// OpenMP threads. Returns the number of passes actually run.
+int radixSortKeys(std::vector<SortKey> &keys, std::vector<unsigned int> &order,
+                  std::vector<SortKey> &keyScratch,
+                  std::vector<unsigned int> &orderScratch, int threads = 1);
+
+#endif
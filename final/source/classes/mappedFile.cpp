@@ -0,0 +1,107 @@
+#include "mappedFile.hpp"
+
+#include <stddef.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+MappedFile::MappedFile(void) {
+    data = NULL;
+    size = 0;
+    fileHandle = NULL;
+    mapHandle = NULL;
+}
+
+MappedFile::~MappedFile(void) {
+    close();
+}
+
+bool MappedFile::isOpen(void) const {
+    return data != NULL;
+}
+
+#ifdef _WIN32
+
+bool MappedFile::open(const char *file) {
+    close();
+    HANDLE f = CreateFileA(file, GENERIC_READ, FILE_SHARE_READ, NULL,
+                           OPEN_EXISTING, FILE_FLAG_RANDOM_ACCESS, NULL);
+    if (f == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+    LARGE_INTEGER length;
+    if (!GetFileSizeEx(f, &length) || length.QuadPart == 0 ||
+        (unsigned long long)length.QuadPart > (size_t)-1) {
+        CloseHandle(f);
+        return false;
+    }
+    HANDLE m = CreateFileMappingA(f, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (m == NULL) {
+        CloseHandle(f);
+        return false;
+    }
+    void *view = MapViewOfFile(m, FILE_MAP_READ, 0, 0, 0);
+    if (view == NULL) {
+        CloseHandle(m);
+        CloseHandle(f);
+        return false;
+    }
+    fileHandle = f;
+    mapHandle = m;
+    data = (const unsigned char *)view;
+    size = length.QuadPart;
+    return true;
+}
+
+void MappedFile::close(void) {
+    if (data != NULL) {
+        UnmapViewOfFile(data);
+        CloseHandle((HANDLE)mapHandle);
+        CloseHandle((HANDLE)fileHandle);
+    }
+    data = NULL;
+    size = 0;
+    fileHandle = NULL;
+    mapHandle = NULL;
+}
+
+#else
+
+bool MappedFile::open(const char *file) {
+    close();
+    int fd = ::open(file, O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size == 0 ||
+        (unsigned long long)info.st_size > (size_t)-1) {
+        ::close(fd);
+        return false;
+    }
+    void *view = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    // The mapping keeps the file open
+    ::close(fd);
+    if (view == MAP_FAILED) {
+        return false;
+    }
+    data = (const unsigned char *)view;
+    size = info.st_size;
+    return true;
+}
+
+void MappedFile::close(void) {
+    if (data != NULL) {
+        munmap((void *)data, size);
+    }
+    data = NULL;
+    size = 0;
+}
+
+#endif
@@ -0,0 +1,28 @@
+#ifndef __MAPPEDFILE_H
+#define __MAPPEDFILE_H
+
+/*
+  A whole file mapped read only into memory. Pages are read in by the
+  system as they are touched, so opening costs the same for any size.
+  32 bit builds can only map files that fit in their address space.
+ */
+class MappedFile {
+public:
+    const unsigned char *data;
+    unsigned long long size;
+
+    MappedFile(void);
+    ~MappedFile(void);
+
+    // Returns false if the file is missing, empty or cannot be mapped
+    bool open(const char *file);
+    void close(void);
+    bool isOpen(void) const;
+
+private:
+    // Platform handles of the mapping
+    void *fileHandle;
+    void *mapHandle;
+};
+
+#endif
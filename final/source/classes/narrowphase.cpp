@@ -0,0 +1,431 @@
+#include "narrowphase.hpp"
+
+//project v2 on v1
+glm::vec2 project(glm::vec2 v1, glm::vec2 v2) {
+    return glm::dot(v2, glm::normalize(v1)) * glm::normalize(v1);
+}
+
+// The normal of each edge is the part of (mid - edge start) perpendicular
+// to the edge, flipped to point away from mid
+void edgeNormals(const glm::vec2 *pts, const glm::vec2 &mid,
+                 glm::vec2 *norms) {
+    for (int i = 0; i < 3; i++) {
+        norms[i] = project(pts[(i + 1) % 3] - pts[i], mid - pts[i]);
+        norms[i] = glm::normalize(norms[i] - (mid - pts[i]));
+    }
+}
+
+/*
+  Returns true if there is a collision between objects using SAT
+  collision detection.  If there is a collision, colVec will contain
+  the minimal vector to resolve collision.  colVec is from A to B
+  (i.e. B-A).
+
+  There is no information of where the collision occurs in this algo.
+  Callers are expected to have rejected the pair on bounding boxes first.
+  Edge normals come precomputed in the views.
+ */
+bool satCollision(const BodyView &a, const BodyView &b, glm::vec2 &colVec) {
+    int axis = -1;
+    return satCollision(a, b, colVec, axis);
+}
+
+// Projections of A and B onto normal
+static inline void projectPair(const glm::vec2 *ptsA, const glm::vec2 *ptsB,
+                               glm::vec2 normal, float &minA, float &maxA,
+                               float &minB, float &maxB) {
+    minA = FLT_MAX;
+    maxA = -FLT_MAX;
+    minB = FLT_MAX;
+    maxB = -FLT_MAX;
+    for (int i = 0; i < 3; i++) {
+        float projDist = glm::dot(ptsA[i], normal);
+        if (projDist < minA) { minA = projDist;}
+        if (projDist > maxA) { maxA = projDist;}
+        projDist = glm::dot(ptsB[i], normal);
+        if (projDist < minB) { minB = projDist;}
+        if (projDist > maxB) { maxB = projDist;}
+    }
+}
+
+/*
+  Bodies that were apart last step are usually still apart along the
+  same axis, so that one is tried before the full loop. The full loop
+  runs in the usual order so touching pairs get the same colVec.
+ */
+bool satCollision(const BodyView &a, const BodyView &b, glm::vec2 &colVec,
+                  int &axis) {
+    const glm::vec2 * ptsA = a.pts;
+    const glm::vec2 * ptsB = b.pts;
+    //All 6 norms of the triangles, first 3 are from B, last are from A
+    const glm::vec2 * norms[6] = {
+        &b.norms[0], &b.norms[1], &b.norms[2],
+        &a.norms[0], &a.norms[1], &a.norms[2]
+    };
+    float minA;
+    float maxA;
+    float minB;
+    float maxB;
+    if (axis >= 0 && axis < 6) {
+        projectPair(ptsA, ptsB, *norms[axis], minA, maxA, minB, maxB);
+        if ((minA > maxB) || (maxA < minB)) {
+            return false;
+        }
+    }
+    float minDepth = FLT_MAX;
+    for (int j = 0; j < 6; j++) {
+        glm::vec2 normal = *norms[j];
+        projectPair(ptsA, ptsB, normal, minA, maxA, minB, maxB);
+
+        // If we find some gap, return false immeditely
+        if ((minA > maxB) || (maxA < minB)) {
+            axis = j;
+            return false;
+        } else {
+            //Needs fixing
+            if ((maxA > minB && minB > minA) && (maxA - minB < minDepth)) {
+                colVec = normal * -1.0f * (maxA - minB);
+                minDepth = maxA - minB;
+            } else if ((minA < maxB && minA > minB) && (maxB - minA < minDepth)) {
+                colVec = normal * (maxB - minA);
+                minDepth = maxB - minA;
+            }
+            if (glm::dot(colVec, (b.mid - a.mid)) < 0.0f) {
+                colVec *= -1.0f;
+            }
+        }
+    }
+    axis = -1;
+    return true;
+}
+
+// Clips v1 and v2 into pts based on whether they are further than cutoff along norm
+// returns the number of points kept stored in pts
+int clip(glm::vec2 v1, glm::vec2 v2, glm::vec2 norm,
+         float cutoff, glm::vec2 *pts) {
+    int kept = 0;
+    float dist1 = glm::dot(norm, v1) - cutoff;
+    float dist2 = glm::dot(norm, v2) - cutoff;
+    if (dist1 > 0.0f) {
+        pts[kept] = v1;
+        kept++;
+    }
+    if (dist2 > 0.0f) {
+        pts[kept] = v2;
+        kept++;
+    }
+    if (dist1 * dist2 < 0.0f) {
+        glm::vec2 dif = v2 - v1;
+        float percLeft = dist1 / (dist1 - dist2);
+        dif *= percLeft;
+        dif += v1;
+        pts[kept] = dif;
+        kept++;
+    }
+    return kept;
+}
+
+// selects an edge from this that is most perpindicular to norm
+// chosenPt is edge furthest along norm
+// Two pts used stored inside edge
+void bestEdge(const glm::vec2 *verts, glm::vec2 norm,
+              glm::vec2 &chosenPt, glm::vec2 *edge) {
+    float max = -FLT_MAX;
+    int index = 0;
+    //Make index the pt furthest into other shape
+    for (int i = 0; i < 3; i++) {
+        float proj = glm::dot(norm, verts[i]);
+        if (proj > max) {
+            max = proj;
+            index = i;
+        }
+    }
+    chosenPt = verts[index];
+    glm::vec2 v0 = verts[(index + 2) % 3];
+    glm::vec2 v1 = verts[(index + 1) % 3];
+    glm::vec2 cw = chosenPt - v0;
+    glm::vec2 ccw = chosenPt - v1;
+    // Want the edge most perpendicular
+    if (glm::dot(cw, norm) < glm::dot(ccw, norm)) {
+        edge[0] = v0;
+        edge[1] = chosenPt;
+    } else {
+        edge[0] = chosenPt;
+        edge[1] = v1;
+    }
+}
+
+
+// Uses clipping to determine the collision point between triangle A and B
+// given the SAT discovered minimal translation vector colVec
+bool clipCollisionPt(const glm::vec2 *ptsA, const glm::vec2 *ptsB,
+                     glm::vec2 colVec, glm::vec2 &colPt) {
+    glm::vec2 colNorm = glm::normalize(colVec);
+    glm::vec2 edgeA[2];
+    glm::vec2 ptA;
+    glm::vec2 edgeB[2];
+    glm::vec2 ptB;
+    bestEdge(ptsA, colNorm, ptA, edgeA);
+    bestEdge(ptsB, -1.0f * colNorm, ptB, edgeB);
+
+    glm::vec2 ref[2];
+    glm::vec2 inc[2];
+    glm::vec2 refPt;
+    bool flip = false;
+    float edgeAD =
+        glm::dot(ptA - (ptA == edgeA[0] ? edgeA[1] : edgeA[0]), colNorm);
+    float edgeBD =
+        glm::dot(ptB - (ptB == edgeB[0] ? edgeB[1] : edgeB[0]), colNorm);
+    if (edgeAD < edgeBD) {
+        refPt = ptA;
+        ref[0] = edgeA[0];
+        ref[1] = edgeA[1];
+        inc[0] = edgeB[0];
+        inc[1] = edgeB[1];
+    } else {
+        refPt = ptB;
+        ref[0] = edgeB[0];
+        ref[1] = edgeB[1];
+        inc[0] = edgeA[0];
+        inc[1] = edgeA[1];
+        flip = true;
+    }
+
+    glm::vec2 clipN1 = glm::normalize(ref[1] - ref[0]);
+    glm::vec2 clipped[2];
+    int kept = clip(inc[0], inc[1], clipN1,
+                    glm::dot(ref[0], clipN1), clipped);
+    if (kept < 2) {
+        return false;
+    }
+
+    kept = clip(clipped[0], clipped[1], -1.0f * clipN1,
+                -1.0f * glm::dot(ref[1], clipN1), clipped);
+    if (kept < 2) {
+        return false;
+    }
+
+    glm::vec2 clipN3 = glm::vec2(clipN1[1], clipN1[0] * -1.0f);
+    if (flip) {
+        clipN3 *= -1.0f;
+    }
+    float max = glm::dot(clipN3, refPt);
+
+    float clip0Depth = glm::dot(clipN3, clipped[0]) - max;
+    float clip1Depth = glm::dot(clipN3, clipped[1]) - max;
+    if (clip0Depth < 0.0f) {
+        clipped[0] = clipped[1];
+        kept--;
+    }
+
+    if (clip1Depth < 0.0f) {
+        if (kept == 2) {
+            clipped[0] = clipped[1];
+        }
+        kept--;
+    }
+
+    if (kept == 2) {
+        colPt = (clipped[0] + clipped[1]) / 2.0f;
+        return true;
+    } else if (kept == 1) {
+        colPt = clipped[0];
+        return true;
+    }
+    return false;
+}
+
+
+
+void capFloat(float& input, float max) {
+    if (input > max) {
+        input = max;
+    } else if (input < -max) {
+        input = -max;
+    }
+}
+
+/*
+  Works out the force needed to fix the collision at colPt according to
+  hookes law. linForce is applied to A and its opposite to B, rotA and
+  rotB are the rotational forces of each.
+ */
+void springForces(const glm::vec2 &midA, const glm::vec2 &midB,
+                  glm::vec2 colPt, glm::vec2 sprVec,
+                  glm::vec2 &linForce, float &rotA, float &rotB) {
+    //force is sum total of forces of each spring in cols
+    // This is only doing linear force
+    linForce = glm::vec2(0.0f, 0.0f);
+    rotA = 0.0f;
+    rotB = 0.0f;
+
+    glm::vec2 force = sprVec * HOOKE_CONSTANT;
+    linForce += force;
+    //project Force onto radius line
+    //subtract of this to get perpindicular force
+    glm::vec2 t1Radius = colPt - midA;
+    glm::vec2 t2Radius = colPt - midB;
+    glm::vec2 t1PerpForce = force - glm::dot(force, glm::normalize(t1Radius));
+    glm::vec2 t2PerpForce = force - glm::dot(force, glm::normalize(t2Radius));
+
+    // CCW checks to see what direction the rotation is in
+    // It would be great to replace with something cheaper
+    bool ccw = glm::cross(glm::vec3(t1PerpForce, 0.0f),
+                          glm::vec3(t1Radius, 0.0f)).z > 0.0f;
+    bool ccw2 = glm::cross(glm::vec3(t2PerpForce, 0.0f),
+                           glm::vec3(t2Radius, 0.0f)).z > 0.0f;
+
+    rotA +=  (-1.0f + ccw * 2.0f) * glm::length(t1PerpForce)
+        / glm::length(t1Radius);
+    rotB +=  (-1.0f + ccw2 * 2.0f) * glm::length(t2PerpForce)
+        / glm::length(t2Radius);
+
+    capFloat(linForce[0], 1.0f);
+    capFloat(linForce[1], 1.0f);
+    capFloat(rotA, 0.4f);
+    capFloat(rotB, 0.4f);
+}
+
+/*
+  Runs the whole narrowphase for A against B and fills contact. Nothing
+  is written back to either body, the caller applies contact's forces.
+ */
+bool collidePair(const BodyView &a, const BodyView &b, Contact &contact) {
+    int axis = -1;
+    return collidePair(a, b, contact, axis);
+}
+
+bool collidePair(const BodyView &a, const BodyView &b, Contact &contact,
+                 int &axis) {
+    contact.hit = false;
+    glm::vec2 colVec;
+    if (! satCollision(a, b, colVec, axis)) {
+        return false;
+    }
+    return contactFromSat(a, b, colVec, contact);
+}
+
+bool contactFromSat(const BodyView &a, const BodyView &b, glm::vec2 colVec,
+                    Contact &contact) {
+    contact.hit = false;
+    glm::vec2 colPt;
+    if (! clipCollisionPt(a.pts, b.pts, colVec, colPt)) {
+        return false;
+    }
+
+    //reverse this
+    colPt += colVec;
+    colVec = -colVec;
+    springForces(a.mid, b.mid, colPt, colVec,
+                 contact.linForce, contact.rotA, contact.rotB);
+    contact.depth = glm::length(colVec);
+    contact.hit = true;
+    return true;
+}
+
+/*
+  Pairs sit in lanes, so each step of the scalar loop runs for every
+  pair at once. The loop cannot stop at the first gap; a lane that finds
+  one is marked separated and its later values are ignored. Operations
+  and their order match satCollision so the results are the same bits.
+ */
+void satBatch(const BodyView *a, const BodyView *b, int n, bool *hit,
+              glm::vec2 *colVec) {
+#if SIMD_LANES > 1
+    const int L = SIMD_LANES;
+    // Lane copies of every point, normal and centroid. Unused lanes
+    // repeat pair 0.
+    float ptsAX[3][L], ptsAY[3][L], ptsBX[3][L], ptsBY[3][L];
+    float normX[6][L], normY[6][L];
+    float difX[L], difY[L];
+    for (int l = 0; l < L; l++) {
+        int k = l < n ? l : 0;
+        for (int i = 0; i < 3; i++) {
+            ptsAX[i][l] = a[k].pts[i][0];
+            ptsAY[i][l] = a[k].pts[i][1];
+            ptsBX[i][l] = b[k].pts[i][0];
+            ptsBY[i][l] = b[k].pts[i][1];
+            //First 3 are from B, last are from A
+            normX[i][l] = b[k].norms[i][0];
+            normY[i][l] = b[k].norms[i][1];
+            normX[i + 3][l] = a[k].norms[i][0];
+            normY[i + 3][l] = a[k].norms[i][1];
+        }
+        difX[l] = b[k].mid[0] - a[k].mid[0];
+        difY[l] = b[k].mid[1] - a[k].mid[1];
+    }
+
+    vfloat zero = vset(0.0f);
+    vfloat negOne = vset(-1.0f);
+    vfloat separated = zero;
+    vfloat minDepth = vset(FLT_MAX);
+    vfloat colX = zero;
+    vfloat colY = zero;
+    vfloat dx = vload(difX);
+    vfloat dy = vload(difY);
+    for (int j = 0; j < 6; j++) {
+        vfloat nx = vload(normX[j]);
+        vfloat ny = vload(normY[j]);
+        vfloat minA = vset(FLT_MAX);
+        vfloat maxA = vset(-FLT_MAX);
+        vfloat minB = minA;
+        vfloat maxB = maxA;
+        for (int i = 0; i < 3; i++) {
+            vfloat proj = vadd(vmul(vload(ptsAX[i]), nx),
+                               vmul(vload(ptsAY[i]), ny));
+            minA = vmin(minA, proj);
+            maxA = vmax(maxA, proj);
+            proj = vadd(vmul(vload(ptsBX[i]), nx), vmul(vload(ptsBY[i]), ny));
+            minB = vmin(minB, proj);
+            maxB = vmax(maxB, proj);
+        }
+        separated = vor(separated, vor(vgt(minA, maxB), vlt(maxA, minB)));
+
+        vfloat depthA = vsub(maxA, minB);
+        vfloat depthB = vsub(maxB, minA);
+        vfloat useA = vand(vand(vgt(maxA, minB), vgt(minB, minA)),
+                           vlt(depthA, minDepth));
+        vfloat useB = vandnot(useA,
+                              vand(vand(vlt(minA, maxB), vgt(minA, minB)),
+                                   vlt(depthB, minDepth)));
+        colX = vselect(useA, colX, vmul(vmul(nx, negOne), depthA));
+        colY = vselect(useA, colY, vmul(vmul(ny, negOne), depthA));
+        minDepth = vselect(useA, minDepth, depthA);
+        colX = vselect(useB, colX, vmul(nx, depthB));
+        colY = vselect(useB, colY, vmul(ny, depthB));
+        minDepth = vselect(useB, minDepth, depthB);
+
+        vfloat flip = vlt(vadd(vmul(colX, dx), vmul(colY, dy)), zero);
+        colX = vselect(flip, colX, vmul(colX, negOne));
+        colY = vselect(flip, colY, vmul(colY, negOne));
+    }
+
+    int mask = vmask(separated);
+    float outX[L];
+    float outY[L];
+    vstore(outX, colX);
+    vstore(outY, colY);
+    for (int l = 0; l < n; l++) {
+        hit[l] = (mask & (1 << l)) == 0;
+        colVec[l] = glm::vec2(outX[l], outY[l]);
+    }
+#else
+    for (int l = 0; l < n; l++) {
+        colVec[l] = glm::vec2(0.0f, 0.0f);
+        hit[l] = satCollision(a[l], b[l], colVec[l]);
+    }
+#endif
+}
+
+void collideBatch(const BodyView *a, const BodyView *b, int n,
+                  Contact *contacts) {
+    bool hit[SIMD_LANES];
+    glm::vec2 colVec[SIMD_LANES];
+    satBatch(a, b, n, hit, colVec);
+    for (int l = 0; l < n; l++) {
+        contacts[l].hit = false;
+        if (hit[l]) {
+            contactFromSat(a[l], b[l], colVec[l], contacts[l]);
+        }
+    }
+}
@@ -0,0 +1,83 @@
+#ifndef __NARROWPHASE_H
+#define __NARROWPHASE_H
+
+#include <glm.hpp>
+#include <cfloat>
+
+#include "simd.hpp"
+
+#define HOOKE_CONSTANT 10.0f
+
+// Candidate pair produced by the broadphase. a is a slot in the moving
+// bodies, b is a slot in the moving bodies or, if isStatic, in statics.
+struct BodyPair {
+    unsigned int a;
+    unsigned int b;
+    bool isStatic;
+};
+
+// Narrowphase result for one pair. Filled in place so pairs can be
+// processed independently and the forces applied afterwards.
+struct Contact {
+    bool hit;
+    //Spring force applied to a (b gets the opposite)
+    glm::vec2 linForce;
+    //Rotational force for each body
+    float rotA;
+    float rotB;
+    //Length of the SAT vector, how far the bodies overlap
+    float depth;
+};
+
+// Everything the narrowphase reads about one body. Filled from the
+// cached values in a BodyStore, so no per pair geometry is recomputed.
+struct BodyView {
+    glm::vec2 pts[3];
+    //Outward unit normal of the edge pts[i] -> pts[(i + 1) % 3]
+    glm::vec2 norms[3];
+    glm::vec2 mid;
+};
+
+/*
+  Kernels shared by Triangle and Grid. They work on three vertices and a
+  precomputed centroid so callers can pass views straight out of a
+  BodyStore instead of building Triangles.
+ */
+
+// Outward unit edge normals of pts, mid is the centroid of pts
+void edgeNormals(const glm::vec2 *pts, const glm::vec2 &mid,
+                 glm::vec2 *norms);
+// SAT test between A and B, colVec is minimal vector from A to B
+bool satCollision(const BodyView &a, const BodyView &b, glm::vec2 &colVec);
+// As above but tries axis first, 0-2 are B's edge normals and 3-5 A's.
+// On return axis is the separating axis found, or -1 if they touch.
+bool satCollision(const BodyView &a, const BodyView &b, glm::vec2 &colVec,
+                  int &axis);
+// Edge of verts most perpindicular to norm and the point furthest along it
+void bestEdge(const glm::vec2 *verts, glm::vec2 norm,
+              glm::vec2 &chosenPt, glm::vec2 *edge);
+// Clipping to find where A and B touch given the SAT vector
+bool clipCollisionPt(const glm::vec2 *ptsA, const glm::vec2 *ptsB,
+                     glm::vec2 colVec, glm::vec2 &colPt);
+// Hooke's law spring forces for a contact at colPt stretched by sprVec
+void springForces(const glm::vec2 &midA, const glm::vec2 &midB,
+                  glm::vec2 colPt, glm::vec2 sprVec,
+                  glm::vec2 &linForce, float &rotA, float &rotB);
+// Full narrowphase for one pair: SAT, clipping and spring forces
+bool collidePair(const BodyView &a, const BodyView &b, Contact &contact);
+// collidePair warm started with a separating axis from an earlier step,
+// see the satCollision overload for axis
+bool collidePair(const BodyView &a, const BodyView &b, Contact &contact,
+                 int &axis);
+// Clipping and spring forces for a pair SAT found touching along colVec
+bool contactFromSat(const BodyView &a, const BodyView &b, glm::vec2 colVec,
+                    Contact &contact);
+// satCollision for n pairs a[i], b[i] at once, n at most SIMD_LANES.
+// Gives exactly the scalar results, lanes only replace the loop.
+void satBatch(const BodyView *a, const BodyView *b, int n, bool *hit,
+              glm::vec2 *colVec);
+// collidePair for n pairs with the SAT step batched
+void collideBatch(const BodyView *a, const BodyView *b, int n,
+                  Contact *contacts);
+
+#endif
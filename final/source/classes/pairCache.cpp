@@ -0,0 +1,182 @@
+#include "pairCache.hpp"
+
+#include <cmath>
+
+// Moving pairs use both ids, low id second. Static pairs set the top bit
+// and use the static's slot, which never changes.
+static inline unsigned long long cacheKey(unsigned int idA, unsigned int b,
+                                          bool isStatic) {
+    if (isStatic) {
+        return (1ULL << 63) | ((unsigned long long)idA << 32) | b;
+    }
+    if (idA < b) {
+        unsigned int t = idA;
+        idA = b;
+        b = t;
+    }
+    return ((unsigned long long)idA << 32) | b;
+}
+
+// True if no vertex of pts moved more than dist from old
+static inline bool within(const glm::vec2 *pts, const glm::vec2 *old,
+                          float dist) {
+    for (int i = 0; i < 3; i++) {
+        if (std::fabs(pts[i][0] - old[i][0]) > dist ||
+            std::fabs(pts[i][1] - old[i][1]) > dist) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Every bit of the key mixed into the index with murmur3's fmix64. Ids
+// sit in both halves and the static flag in the top bit, so taking a few
+// bits of either piles a body's pairs, or terrain pairs, onto the same
+// slots and linear probing then walks long runs.
+static inline unsigned int hashKey(unsigned long long key, unsigned int mask) {
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdULL;
+    key ^= key >> 33;
+    key *= 0xc4ceb9fe1a85ec53ULL;
+    key ^= key >> 33;
+    return (unsigned int)key & mask;
+}
+
+PairCache::PairCache(void) {
+    stamp = 0;
+    used = 0;
+    reuseDistance = 0.0f;
+    lookups = 0;
+    hits = 0;
+    earlyExits = 0;
+    reused = 0;
+}
+
+void PairCache::clear(void) {
+    keys.clear();
+    entries.clear();
+    saved.clear();
+    slots.clear();
+    used = 0;
+}
+
+unsigned int PairCache::find(unsigned long long key, bool &inserted) {
+    unsigned int mask = keys.size() - 1;
+    unsigned int i = hashKey(key, mask);
+    while (keys[i] != CACHE_EMPTY) {
+        if (keys[i] == key) {
+            inserted = false;
+            return i;
+        }
+        i = (i + 1) & mask;
+    }
+    keys[i] = key;
+    used++;
+    inserted = true;
+    return i;
+}
+
+void PairCache::rebuild(unsigned int size, bool onlyCurrent) {
+    std::vector<unsigned long long> oldKeys(size, CACHE_EMPTY);
+    std::vector<CachedPair> oldEntries(size);
+    std::vector<SavedContact> oldSaved(reuseDistance > 0.0f ? size : 0);
+    oldKeys.swap(keys);
+    oldEntries.swap(entries);
+    oldSaved.swap(saved);
+    used = 0;
+    bool inserted;
+    for (unsigned int i = 0; i < oldKeys.size(); i++) {
+        if (oldKeys[i] == CACHE_EMPTY ||
+            (onlyCurrent && oldEntries[i].stamp != stamp)) {
+            continue;
+        }
+        unsigned int index = find(oldKeys[i], inserted);
+        entries[index] = oldEntries[i];
+        if (!saved.empty() && !oldSaved.empty()) {
+            saved[index] = oldSaved[i];
+        } else {
+            entries[index].hasContact = false;
+        }
+    }
+}
+
+void PairCache::lookup(const std::vector<BodyPair> &pairs,
+                       BodyStore &bodies) {
+    stamp++;
+    lookups = pairs.size();
+    hits = 0;
+    earlyExits = 0;
+    reused = 0;
+    // Keep the table under half full
+    unsigned int size = keys.size() < 64 ? 64 : keys.size();
+    while (size < 2 * (used + pairs.size())) {
+        size *= 2;
+    }
+    if (size != keys.size() ||
+        (reuseDistance > 0.0f) != (saved.size() == keys.size())) {
+        rebuild(size, false);
+    }
+
+    slots.resize(pairs.size());
+    bool inserted;
+    for (unsigned int p = 0; p < pairs.size(); p++) {
+        const BodyPair &pair = pairs[p];
+        unsigned int idA = bodies.idOf[pair.a];
+        unsigned int b = pair.isStatic ? pair.b : bodies.idOf[pair.b];
+        unsigned int index = find(cacheKey(idA, b, pair.isStatic), inserted);
+        CachedPair &entry = entries[index];
+        if (inserted) {
+            entry.aId = idA;
+            entry.axis = -1;
+            entry.hasContact = false;
+        } else {
+            hits++;
+        }
+        entry.stamp = stamp;
+        slots[p] = index;
+    }
+}
+
+int PairCache::collide(const BodyView &a, const BodyView &b, unsigned int aId,
+                       unsigned int index, Contact &contact) {
+    CachedPair &entry = entries[index];
+    // Bodies swap slots as they are sorted, flip the axis to match
+    bool flipped = entry.aId != aId;
+    int axis = entry.axis;
+    if (flipped && axis >= 0) {
+        axis = (axis + 3) % 6;
+    }
+
+    bool reuse = !saved.empty();
+    if (reuse && entry.hasContact && !flipped &&
+        within(a.pts, saved[index].ptsA, reuseDistance) &&
+        within(b.pts, saved[index].ptsB, reuseDistance)) {
+        contact = saved[index].contact;
+        return CACHE_REUSED;
+    }
+
+    int hint = axis;
+    collidePair(a, b, contact, axis);
+    entry.aId = aId;
+    entry.axis = axis;
+    entry.hasContact = reuse && contact.hit;
+    if (entry.hasContact) {
+        SavedContact &save = saved[index];
+        for (int i = 0; i < 3; i++) {
+            save.ptsA[i] = a.pts[i];
+            save.ptsB[i] = b.pts[i];
+        }
+        save.contact = contact;
+    }
+    if (hint >= 0 && axis == hint) {
+        return CACHE_EARLY_EXIT;
+    }
+    return CACHE_FULL;
+}
+
+void PairCache::prune(void) {
+    if (stamp % CACHE_PRUNE_INTERVAL != 0) {
+        return;
+    }
+    rebuild(keys.size(), true);
+}
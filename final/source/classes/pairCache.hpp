@@ -0,0 +1,90 @@
+#ifndef __PAIRCACHE_H
+#define __PAIRCACHE_H
+
+#include <vector>
+
+#include "bodyStore.hpp"
+#include "narrowphase.hpp"
+
+// Steps between sweeps that drop pairs the broadphase stopped finding
+#define CACHE_PRUNE_INTERVAL 32
+
+// How PairCache::collide got its result
+#define CACHE_FULL 0
+#define CACHE_EARLY_EXIT 1
+#define CACHE_REUSED 2
+
+// Empty slot in the table
+#define CACHE_EMPTY 0xffffffffffffffffULL
+
+// What the narrowphase kept about a pair from the last step it was seen
+struct CachedPair {
+    // Id of the body that was in the a slot, axis and saved pts are
+    // relative to it
+    unsigned int aId;
+    // Separating axis as numbered by satCollision, -1 if touching
+    int axis;
+    // Step the pair was last looked up
+    unsigned int stamp;
+    // Whether the saved contact can be reused
+    bool hasContact;
+};
+
+// Last contact of a touching pair and where the bodies were. Kept apart
+// from CachedPair as it is only read when reuse is on.
+struct SavedContact {
+    glm::vec2 ptsA[3];
+    glm::vec2 ptsB[3];
+    Contact contact;
+};
+
+/*
+  Narrowphase state kept between substeps, keyed by body ids so it
+  survives bodies being re-sorted. An open addressed table with linear
+  probing; it only grows during a step and stale entries are dropped by
+  rebuilding it in prune. Entries are looked up serially and can then be
+  filled in by parallel narrowphase workers.
+ */
+class PairCache {
+public:
+    // Power of two sized, keys[i] == CACHE_EMPTY for unused entries
+    std::vector<unsigned long long> keys;
+    std::vector<CachedPair> entries;
+    // Same indexing as entries, empty while reuseDistance is 0
+    std::vector<SavedContact> saved;
+    unsigned int used;
+    // Entry index for each pair of the last lookup
+    std::vector<unsigned int> slots;
+    unsigned int stamp;
+    // A touching pair whose vertices all moved less than this reuses
+    // its last contact. 0 turns reuse off.
+    float reuseDistance;
+
+    // Counters for the last step. The caller adds up what collide returns
+    // into earlyExits and reused.
+    unsigned long long lookups;
+    unsigned long long hits;
+    unsigned long long earlyExits;
+    unsigned long long reused;
+
+    PairCache(void);
+    void clear(void);
+
+    // Point slots[p] at the entry for pairs[p], creating missing ones
+    void lookup(const std::vector<BodyPair> &pairs, BodyStore &bodies);
+    // Narrowphase a against b using and updating entry. Safe to call in
+    // parallel for different entries.
+    int collide(const BodyView &a, const BodyView &b, unsigned int aId,
+                unsigned int index, Contact &contact);
+    // Drop entries not looked up this step, every CACHE_PRUNE_INTERVAL
+    void prune(void);
+
+private:
+    // Index of key, inserting it if missing
+    unsigned int find(unsigned long long key, bool &inserted);
+    // Rehash into size entries, keeping those stamped this step if
+    // onlyCurrent
+    void rebuild(unsigned int size, bool onlyCurrent);
+};
+
+#endif
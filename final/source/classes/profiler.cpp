@@ -0,0 +1,374 @@
+#include "profiler.hpp"
+
+#include <stdio.h>
+#include <cfloat>
+#include <omp.h>
+
+#include "taskPool.hpp"
+#include "timer.hpp"
+
+static const char *phaseNames[PHASE_COUNT] = {
+    "integrate", "sort", "pairs", "narrow", "sat", "clip", "response"
+};
+
+static const char *counterNames[COUNT_COUNT] = {
+    "candidates", "aabb_hits", "sat_hits", "contacts", "sort_swaps"
+};
+
+Profiler::Profiler(void) {
+    enabled = true;
+    tracing = false;
+    maxSamples = 0;
+    reset();
+}
+
+const char *Profiler::phaseName(int phase) {
+    return phaseNames[phase];
+}
+
+const char *Profiler::counterName(int counter) {
+    return counterNames[counter];
+}
+
+double Profiler::now(void) {
+    return getTime();
+}
+
+int Profiler::threadIndex(void) {
+    int index = TaskPool::currentWorker();
+    if (index < 0) {
+        index = omp_get_thread_num();
+    }
+    return index < PROFILE_MAX_THREADS ? index : -1;
+}
+
+void Profiler::reset(void) {
+    samples.clear();
+    for (int t = 0; t < PROFILE_MAX_THREADS; t++) {
+        ProfileThread &thread = threads[t];
+        for (int p = 0; p < PHASE_COUNT; p++) {
+            thread.first[p] = DBL_MAX;
+            thread.last[p] = -DBL_MAX;
+            thread.busy[p] = 0.0;
+            thread.totalBusy[p] = 0.0;
+            thread.spans[p] = 0;
+        }
+        for (int c = 0; c < COUNT_COUNT; c++) {
+            thread.counters[c] = 0;
+        }
+        thread.events.clear();
+        thread.droppedEvents = 0;
+    }
+    threadsUsed = 0;
+    origin = getTime();
+    substepBegin = origin;
+    droppedSamples = 0;
+    untrackedSpans = 0;
+}
+
+void Profiler::beginSubstep(void) {
+    if (!enabled) {
+        return;
+    }
+    for (int t = 0; t < threadsUsed; t++) {
+        ProfileThread &thread = threads[t];
+        for (int p = 0; p < PHASE_COUNT; p++) {
+            thread.first[p] = DBL_MAX;
+            thread.last[p] = -DBL_MAX;
+            thread.busy[p] = 0.0;
+        }
+        for (int c = 0; c < COUNT_COUNT; c++) {
+            thread.counters[c] = 0;
+        }
+    }
+    substepBegin = getTime();
+}
+
+void Profiler::endSubstep(void) {
+    if (!enabled) {
+        return;
+    }
+    double end = getTime();
+    ProfileSample sample;
+    sample.begin = substepBegin - origin;
+    sample.wall = end - substepBegin;
+    for (int c = 0; c < COUNT_COUNT; c++) {
+        sample.counters[c] = 0;
+    }
+    // Threads past threadsUsed have only been written if they started
+    // during this substep
+    for (int t = threadsUsed; t < PROFILE_MAX_THREADS; t++) {
+        bool used = false;
+        for (int p = 0; p < PHASE_COUNT; p++) {
+            used = used || threads[t].spans[p] > 0;
+        }
+        for (int c = 0; c < COUNT_COUNT; c++) {
+            used = used || threads[t].counters[c] > 0;
+        }
+        if (used) {
+            threadsUsed = t + 1;
+        }
+    }
+    for (int p = 0; p < PHASE_COUNT; p++) {
+        double first = DBL_MAX;
+        double last = -DBL_MAX;
+        double busy = 0.0;
+        for (int t = 0; t < threadsUsed; t++) {
+            ProfileThread &thread = threads[t];
+            first = thread.first[p] < first ? thread.first[p] : first;
+            last = thread.last[p] > last ? thread.last[p] : last;
+            busy += thread.busy[p];
+        }
+        sample.phaseWall[p] = last > first ? last - first : 0.0;
+        sample.phaseBusy[p] = busy;
+    }
+    for (int t = 0; t < threadsUsed; t++) {
+        for (int c = 0; c < COUNT_COUNT; c++) {
+            sample.counters[c] += threads[t].counters[c];
+        }
+    }
+    samples.push_back(sample);
+    if (maxSamples > 0 && samples.size() >= 2 * maxSamples) {
+        unsigned int drop = samples.size() - maxSamples;
+        samples.erase(samples.begin(), samples.begin() + drop);
+        droppedSamples += drop;
+    }
+}
+
+void Profiler::record(int phase, double begin, double end) {
+    int index = threadIndex();
+    if (index < 0) {
+        untrackedSpans++;
+        return;
+    }
+    ProfileThread &thread = threads[index];
+    if (begin < thread.first[phase]) {
+        thread.first[phase] = begin;
+    }
+    if (end > thread.last[phase]) {
+        thread.last[phase] = end;
+    }
+    thread.busy[phase] += end - begin;
+    thread.totalBusy[phase] += end - begin;
+    thread.spans[phase]++;
+    if (tracing) {
+        if (thread.events.size() < PROFILE_MAX_EVENTS) {
+            ProfileEvent event;
+            event.phase = phase;
+            event.begin = begin - origin;
+            event.end = end - origin;
+            thread.events.push_back(event);
+        } else {
+            thread.droppedEvents++;
+        }
+    }
+}
+
+void Profiler::count(int counter, unsigned long long n) {
+    int index = threadIndex();
+    if (index < 0) {
+        untrackedSpans++;
+        return;
+    }
+    threads[index].counters[counter] += n;
+}
+
+bool Profiler::writeCsv(const char *file) const {
+    FILE *out = fopen(file, "w");
+    if (out == NULL) {
+        return false;
+    }
+    fprintf(out, "substep,begin_ms,wall_ms");
+    for (int p = 0; p < PHASE_COUNT; p++) {
+        fprintf(out, ",%s_wall_ms,%s_busy_ms", phaseNames[p], phaseNames[p]);
+    }
+    for (int c = 0; c < COUNT_COUNT; c++) {
+        fprintf(out, ",%s", counterNames[c]);
+    }
+    fprintf(out, "\n");
+    for (unsigned int s = 0; s < samples.size(); s++) {
+        const ProfileSample &sample = samples[s];
+        fprintf(out, "%llu,%.4f,%.4f", droppedSamples + s,
+                sample.begin * 1000, sample.wall * 1000);
+        for (int p = 0; p < PHASE_COUNT; p++) {
+            fprintf(out, ",%.4f,%.4f", sample.phaseWall[p] * 1000,
+                    sample.phaseBusy[p] * 1000);
+        }
+        for (int c = 0; c < COUNT_COUNT; c++) {
+            fprintf(out, ",%llu", sample.counters[c]);
+        }
+        fprintf(out, "\n");
+    }
+    return fclose(out) == 0;
+}
+
+bool Profiler::writeJson(const char *file) const {
+    FILE *out = fopen(file, "w");
+    if (out == NULL) {
+        return false;
+    }
+    unsigned int n = samples.size();
+    double wall = 0.0;
+    for (unsigned int s = 0; s < n; s++) {
+        wall += samples[s].wall;
+    }
+    fprintf(out, "{\n  \"substeps\": %u,\n  \"wall_ms\": %.4f,\n", n,
+            wall * 1000);
+
+    fprintf(out, "  \"phases\": {\n");
+    for (int p = 0; p < PHASE_COUNT; p++) {
+        double sumWall = 0.0, sumBusy = 0.0, maxWall = 0.0;
+        for (unsigned int s = 0; s < n; s++) {
+            sumWall += samples[s].phaseWall[p];
+            sumBusy += samples[s].phaseBusy[p];
+            if (samples[s].phaseWall[p] > maxWall) {
+                maxWall = samples[s].phaseWall[p];
+            }
+        }
+        fprintf(out, "    \"%s\": {\"wall_ms\": %.4f, \"busy_ms\": %.4f, "
+                "\"mean_wall_ms\": %.4f, \"max_wall_ms\": %.4f}%s\n",
+                phaseNames[p], sumWall * 1000, sumBusy * 1000,
+                n > 0 ? sumWall / n * 1000 : 0.0, maxWall * 1000,
+                p + 1 < PHASE_COUNT ? "," : "");
+    }
+    fprintf(out, "  },\n");
+
+    fprintf(out, "  \"counters\": {\n");
+    for (int c = 0; c < COUNT_COUNT; c++) {
+        unsigned long long total = 0, most = 0;
+        for (unsigned int s = 0; s < n; s++) {
+            total += samples[s].counters[c];
+            if (samples[s].counters[c] > most) {
+                most = samples[s].counters[c];
+            }
+        }
+        fprintf(out, "    \"%s\": {\"total\": %llu, \"mean\": %.2f, "
+                "\"max\": %llu}%s\n", counterNames[c], total,
+                n > 0 ? (double)total / n : 0.0, most,
+                c + 1 < COUNT_COUNT ? "," : "");
+    }
+    fprintf(out, "  },\n");
+
+    fprintf(out, "  \"threads\": [\n");
+    for (int t = 0; t < threadsUsed; t++) {
+        fprintf(out, "    {\"thread\": %d", t);
+        for (int p = 0; p < PHASE_COUNT; p++) {
+            fprintf(out, ", \"%s_busy_ms\": %.4f, \"%s_spans\": %llu",
+                    phaseNames[p], threads[t].totalBusy[p] * 1000,
+                    phaseNames[p], threads[t].spans[p]);
+        }
+        fprintf(out, "}%s\n", t + 1 < threadsUsed ? "," : "");
+    }
+    unsigned long long droppedEvents = 0;
+    for (int t = 0; t < threadsUsed; t++) {
+        droppedEvents += threads[t].droppedEvents;
+    }
+    fprintf(out, "  ],\n  \"dropped_events\": %llu,\n", droppedEvents);
+    fprintf(out, "  \"dropped_substeps\": %llu,\n", droppedSamples);
+    fprintf(out, "  \"untracked_spans\": %llu\n}\n",
+            untrackedSpans.load());
+    return fclose(out) == 0;
+}
+
+/*
+  Complete ("X") events in microseconds. Every thread gets its own track
+  and substeps get one more, named through metadata events.
+ */
+bool Profiler::writeTrace(const char *file) const {
+    FILE *out = fopen(file, "w");
+    if (out == NULL) {
+        return false;
+    }
+    int substepTrack = PROFILE_MAX_THREADS;
+    fprintf(out, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+    fprintf(out, "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, "
+            "\"tid\": %d, \"args\": {\"name\": \"substeps\"}}",
+            substepTrack);
+    for (int t = 0; t < threadsUsed; t++) {
+        fprintf(out, ",\n{\"name\": \"thread_name\", \"ph\": \"M\", "
+                "\"pid\": 1, \"tid\": %d, \"args\": {\"name\": "
+                "\"thread %d\"}}", t, t);
+    }
+    for (unsigned int s = 0; s < samples.size(); s++) {
+        const ProfileSample &sample = samples[s];
+        fprintf(out, ",\n{\"name\": \"substep\", \"ph\": \"X\", \"pid\": 1, "
+                "\"tid\": %d, \"ts\": %.3f, \"dur\": %.3f, \"args\": {",
+                substepTrack, sample.begin * 1e6, sample.wall * 1e6);
+        for (int c = 0; c < COUNT_COUNT; c++) {
+            fprintf(out, "%s\"%s\": %llu", c > 0 ? ", " : "",
+                    counterNames[c], sample.counters[c]);
+        }
+        fprintf(out, "}}");
+    }
+    for (int t = 0; t < threadsUsed; t++) {
+        const std::vector<ProfileEvent> &events = threads[t].events;
+        for (unsigned int e = 0; e < events.size(); e++) {
+            fprintf(out, ",\n{\"name\": \"%s\", \"ph\": \"X\", \"pid\": 1, "
+                    "\"tid\": %d, \"ts\": %.3f, \"dur\": %.3f}",
+                    phaseNames[events[e].phase], t, events[e].begin * 1e6,
+                    (events[e].end - events[e].begin) * 1e6);
+        }
+    }
+    fprintf(out, "\n]}\n");
+    return fclose(out) == 0;
+}
+
+void Profiler::report(void) const {
+    unsigned int n = samples.size();
+    if (n == 0) {
+        return;
+    }
+    double wall = 0.0;
+    for (unsigned int s = 0; s < n; s++) {
+        wall += samples[s].wall;
+    }
+    // Phases split into chunks can interleave, so shares are of the busy
+    // time rather than of the wall time
+    double allBusy = 0.0;
+    for (unsigned int s = 0; s < n; s++) {
+        for (int p = 0; p < PHASE_COUNT; p++) {
+            allBusy += samples[s].phaseBusy[p];
+        }
+    }
+    printf("Profile of %u substeps, %.3fms each\n", n, wall / n * 1000);
+    if (droppedSamples > 0) {
+        printf("  %llu earlier substeps dropped\n", droppedSamples);
+    }
+    if (untrackedSpans > 0) {
+        printf("  %llu spans from threads past %d not counted\n",
+               untrackedSpans.load(), PROFILE_MAX_THREADS);
+    }
+    for (int p = 0; p < PHASE_COUNT; p++) {
+        double sumWall = 0.0, sumBusy = 0.0;
+        for (unsigned int s = 0; s < n; s++) {
+            sumWall += samples[s].phaseWall[p];
+            sumBusy += samples[s].phaseBusy[p];
+        }
+        if (sumBusy == 0.0) {
+            continue;
+        }
+        printf("  %-10s wall %8.3fms busy %8.3fms %5.1f%%\n", phaseNames[p],
+               sumWall / n * 1000, sumBusy / n * 1000,
+               100.0 * sumBusy / allBusy);
+    }
+    for (int c = 0; c < COUNT_COUNT; c++) {
+        unsigned long long total = 0;
+        for (unsigned int s = 0; s < n; s++) {
+            total += samples[s].counters[c];
+        }
+        printf("  %-10s %12.1f per substep\n", counterNames[c],
+               (double)total / n);
+    }
+}
+
+ProfileScope::ProfileScope(Profiler *p, int ph) {
+    profiler = p != NULL && p->enabled ? p : NULL;
+    phase = ph;
+    begin = profiler != NULL ? getTime() : 0.0;
+}
+
+ProfileScope::~ProfileScope(void) {
+    if (profiler != NULL) {
+        profiler->record(phase, begin, getTime());
+    }
+}
@@ -0,0 +1,141 @@
+#ifndef __PROFILER_H
+#define __PROFILER_H
+
+#include <vector>
+#include <atomic>
+
+// Stages of a substep that get timed
+enum ProfilePhase {
+    PHASE_INTEGRATE,
+    // Bounds, keys and the sort into rows
+    PHASE_SORT,
+    // Broadphase, candidate pairs
+    PHASE_PAIRS,
+    // Narrowphase done in one go, with the pair cache on
+    PHASE_NARROW,
+    PHASE_SAT,
+    // Clipping and the spring forces of each contact
+    PHASE_CLIP,
+    // Contact forces added to velocities
+    PHASE_RESPONSE,
+    PHASE_COUNT
+};
+
+// Counted per substep
+enum ProfileCounter {
+    // Moving bounding box tests made by the broadphase
+    COUNT_CANDIDATES,
+    // Pairs whose boxes overlap, the narrowphase input
+    COUNT_AABB_HITS,
+    COUNT_SAT_HITS,
+    COUNT_CONTACTS,
+    COUNT_SORT_SWAPS,
+    COUNT_COUNT
+};
+
+// Threads told apart. Spans and counts from threads past the last are
+// dropped rather than shared, and counted in untrackedSpans.
+#define PROFILE_MAX_THREADS 64
+// Trace events kept per thread, later ones are dropped
+#define PROFILE_MAX_EVENTS (1 << 20)
+
+struct ProfileEvent {
+    int phase;
+    double begin;
+    double end;
+};
+
+// Totals of one substep. Wall is from the first span of a phase to the
+// end of its last, busy adds up every span on every thread.
+struct ProfileSample {
+    double begin;
+    double wall;
+    double phaseWall[PHASE_COUNT];
+    double phaseBusy[PHASE_COUNT];
+    unsigned long long counters[COUNT_COUNT];
+};
+
+// What one thread did during the current substep and in total
+struct ProfileThread {
+    double first[PHASE_COUNT];
+    double last[PHASE_COUNT];
+    double busy[PHASE_COUNT];
+    double totalBusy[PHASE_COUNT];
+    unsigned long long spans[PHASE_COUNT];
+    unsigned long long counters[COUNT_COUNT];
+    std::vector<ProfileEvent> events;
+    // Trace events past PROFILE_MAX_EVENTS
+    unsigned long long droppedEvents;
+};
+
+/*
+  Timings and counters for Grid::substep. Code being timed records spans
+  of one phase on whatever thread runs them; spans do not nest, so a
+  stage split over threads records a span per chunk and serial work
+  around it records its own. Each thread writes only its own entry, and
+  the totals are gathered when the substep ends.
+ */
+class Profiler {
+public:
+    // Nothing is recorded while false
+    bool enabled;
+    // Keep every span for writeTrace
+    bool tracing;
+    std::vector<ProfileSample> samples;
+    // Substeps kept in samples, 0 keeps them all. Past that the oldest
+    // are dropped, in batches so the cost stays constant per substep.
+    unsigned int maxSamples;
+
+    Profiler(void);
+
+    // Called by the thread running substep around each one
+    void beginSubstep(void);
+    void endSubstep(void);
+    void record(int phase, double begin, double end);
+    void count(int counter, unsigned long long n);
+    // Clears everything recorded so far
+    void reset(void);
+
+    // One row per substep
+    bool writeCsv(const char *file) const;
+    // Totals per phase, counter and thread
+    bool writeJson(const char *file) const;
+    // Chrome trace event timeline, for chrome://tracing or Perfetto
+    bool writeTrace(const char *file) const;
+    // Short per phase summary to stdout
+    void report(void) const;
+
+    static const char *phaseName(int phase);
+    static const char *counterName(int counter);
+    // Index of the calling thread, its pool worker index or OpenMP
+    // number, or -1 past PROFILE_MAX_THREADS
+    static int threadIndex(void);
+    // getTime, for code that records its own spans
+    static double now(void);
+
+private:
+    ProfileThread threads[PROFILE_MAX_THREADS];
+    // Highest thread index seen plus one
+    int threadsUsed;
+    double origin;
+    double substepBegin;
+    // Samples dropped to stay under maxSamples
+    unsigned long long droppedSamples;
+    // Spans and counts from threads with no entry
+    std::atomic<unsigned long long> untrackedSpans;
+};
+
+// Records a span of phase from construction to destruction, if profiler
+// is set and enabled
+class ProfileScope {
+public:
+    ProfileScope(Profiler *profiler, int phase);
+    ~ProfileScope(void);
+
+private:
+    Profiler *profiler;
+    int phase;
+    double begin;
+};
+
+#endif
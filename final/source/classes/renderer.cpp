@@ -0,0 +1,152 @@
+#include "renderer.hpp"
+
+// Floats per body, 3 vertices of x and y
+#define BODY_FLOATS 6
+
+Renderer::Renderer(void) {
+    glGenBuffers(1, &streamBuf);
+    glGenBuffers(1, &staticBuf);
+    capacity = 0;
+    region = 0;
+    staticCount = 0;
+    for (int i = 0; i < RENDER_FRAMES; i++) {
+        fences[i] = 0;
+    }
+}
+
+// The 3 world vertices of every body in cur, turned and moved alpha of
+// the way from where it was in prev
+void Renderer::fill(const BodySnapshot &prev, const BodySnapshot &cur,
+                    float alpha, const ShapeRegistry &shapes, float *out) {
+    unsigned int have = prev.midX.size();
+    for (unsigned int id = 0; id < cur.midX.size(); id++) {
+        float x = cur.midX[id];
+        float y = cur.midY[id];
+        float a = cur.angle[id];
+        if (id < have) {
+            x = prev.midX[id] + (x - prev.midX[id]) * alpha;
+            y = prev.midY[id] + (y - prev.midY[id]) * alpha;
+            // Shortest way round when the angle wrapped
+            float turn = a - prev.angle[id];
+            if (turn > 180.0f) {
+                turn -= 360.0f;
+            } else if (turn < -180.0f) {
+                turn += 360.0f;
+            }
+            a = prev.angle[id] + turn * alpha;
+        }
+        float r = glm::radians(a);
+        float c = glm::cos(r);
+        float sn = glm::sin(r);
+        unsigned int s = cur.shape[id];
+        for (int i = 0; i < 3; i++) {
+            float lx = shapes.vertX[i][s], ly = shapes.vertY[i][s];
+            out[0] = x + (lx * c - ly * sn);
+            out[1] = y + (lx * sn + ly * c);
+            out += 2;
+        }
+    }
+}
+
+void Renderer::drawBuffer(GLuint buf, GLintptr offset, unsigned int count) {
+    glBindBuffer(GL_ARRAY_BUFFER, buf);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 0, (void *)offset);
+    glDrawArrays(GL_TRIANGLES, 0, count * 3);
+    glDisableVertexAttribArray(0);
+}
+
+/*
+  The vendored GLEW has no ARB_buffer_storage, so instead of a persistent
+  mapping each frame maps its own region unsynchronized and fences it
+  after drawing. Waiting on a region's fence only blocks when the GPU is
+  RENDER_FRAMES frames behind.
+ */
+void Renderer::draw(const BodySnapshot &prev, const BodySnapshot &cur,
+                    float alpha, const ShapeRegistry &shapes) {
+    unsigned int count = cur.midX.size();
+    if (count == 0) {
+        return;
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, streamBuf);
+    if (count > capacity) {
+        // Reallocating orphans the old storage, so old fences can go
+        for (int i = 0; i < RENDER_FRAMES; i++) {
+            if (fences[i] != 0) {
+                glDeleteSync(fences[i]);
+                fences[i] = 0;
+            }
+        }
+        capacity = count + count / 4;
+        glBufferData(GL_ARRAY_BUFFER,
+                     RENDER_FRAMES * capacity * BODY_FLOATS * sizeof(float),
+                     NULL, GL_STREAM_DRAW);
+    }
+
+    region = (region + 1) % RENDER_FRAMES;
+    if (fences[region] != 0) {
+        glClientWaitSync(fences[region], GL_SYNC_FLUSH_COMMANDS_BIT,
+                         1000000000);
+        glDeleteSync(fences[region]);
+        fences[region] = 0;
+    }
+    GLintptr offset = region * capacity * BODY_FLOATS * sizeof(float);
+    float *out = (float *)glMapBufferRange(GL_ARRAY_BUFFER, offset,
+        count * BODY_FLOATS * sizeof(float), GL_MAP_WRITE_BIT |
+        GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+    if (out == NULL) {
+        return;
+    }
+    fill(prev, cur, alpha, shapes, out);
+    glUnmapBuffer(GL_ARRAY_BUFFER);
+
+    drawBuffer(streamBuf, offset, count);
+    fences[region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+void Renderer::setStatics(BodyStore &statics) {
+    staticCount = statics.size();
+    if (staticCount == 0) {
+        return;
+    }
+    std::vector<float> verts;
+    verts.reserve(staticCount * BODY_FLOATS);
+    for (unsigned int slot = 0; slot < staticCount; slot++) {
+        for (int i = 0; i < 3; i++) {
+            verts.push_back(statics.vertX[i][slot]);
+            verts.push_back(statics.vertY[i][slot]);
+        }
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, staticBuf);
+    glBufferData(GL_ARRAY_BUFFER, verts.size() * sizeof(float), &verts[0],
+                 GL_STATIC_DRAW);
+}
+
+void Renderer::drawStatic(void) {
+    if (staticCount > 0) {
+        drawBuffer(staticBuf, 0, staticCount);
+    }
+}
+
+void Renderer::release(void) {
+    for (int i = 0; i < RENDER_FRAMES; i++) {
+        if (fences[i] != 0) {
+            glDeleteSync(fences[i]);
+            fences[i] = 0;
+        }
+    }
+    if (streamBuf != 0) {
+        glDeleteBuffers(1, &streamBuf);
+        streamBuf = 0;
+    }
+    if (staticBuf != 0) {
+        glDeleteBuffers(1, &staticBuf);
+        staticBuf = 0;
+    }
+    capacity = 0;
+    staticCount = 0;
+}
+
+Renderer::~Renderer(void) {
+    release();
+}
@@ -0,0 +1,55 @@
+#ifndef __RENDERER_H
+#define __RENDERER_H
+
+//OpenGL headers
+#include <GL/glew.h>
+#include <GL/glfw.h>
+#include <glm.hpp>
+#include <vector>
+
+#include "bodyStore.hpp"
+#include "simThread.hpp"
+
+// Frames of vertices the stream buffer holds, so the frame being written
+// never touches one the GPU may still be drawing
+#define RENDER_FRAMES 3
+
+// Owns the OpenGL buffers used to draw the simulation so that the
+// physics classes never need a live context. Headless builds leave it
+// out entirely.
+class Renderer {
+public:
+    Renderer(void);
+
+    // Write every body alpha of the way from prev to cur into the stream
+    // buffer and draw them with a single call. Vertices come from shapes.
+    void draw(const BodySnapshot &prev, const BodySnapshot &cur, float alpha,
+              const ShapeRegistry &shapes);
+    // Statics do not move, so they are uploaded once and drawn from there
+    void setStatics(BodyStore &statics);
+    void drawStatic(void);
+
+    // Deletes the buffers and fences while the context is still alive.
+    // Safe to call more than once, the destructor calls it too.
+    void release(void);
+    //Cleans up opengl buffers
+    ~Renderer(void);
+
+private:
+    // RENDER_FRAMES regions of capacity bodies each, one region written
+    // per frame in turn
+    GLuint streamBuf;
+    unsigned int capacity;
+    int region;
+    // Set once the GPU is done with each region's last draw
+    GLsync fences[RENDER_FRAMES];
+
+    GLuint staticBuf;
+    unsigned int staticCount;
+
+    void fill(const BodySnapshot &prev, const BodySnapshot &cur,
+              float alpha, const ShapeRegistry &shapes, float *out);
+    void drawBuffer(GLuint buf, GLintptr offset, unsigned int count);
+};
+
+#endif
@@ -0,0 +1,143 @@
+#include "scene.hpp"
+
+#include <cstdlib> //for srand
+#include <math.h>
+
+// Static base triangle shared by the built in scenes
+void addBase(std::vector<Triangle> &statics) {
+    glm::vec2 baseL(-600.0f, -530.0f);
+    glm::vec2 baseB(0.0f, -1200.0f);
+    glm::vec2 baseR(600.0f, -530.0f);
+    Triangle base = Triangle(baseL, baseB, baseR);
+    // Inverse mass of 0 means infinite mass a.k.a. static object
+    base.invMass = 0.0f;
+    statics.push_back(base);
+}
+
+float buildDefaultScene(std::vector<Triangle> &tris,
+                        std::vector<Triangle> &statics, int divs) {
+    srand(6);
+    glm::vec2 upLeft(-500.0f, 500.0f);
+    glm::vec2 downRight(500.0f, -500.0f);
+    float width = (downRight[0] - upLeft[0]) / divs / 3.0f;
+    for (int i = 0; i < divs; i++) {
+        float port = (downRight[0] - upLeft[0]) / divs;
+        for (int j = 0; j < divs; j++) {
+            float centerX = upLeft[0] + port * i + (float)rand() / RAND_MAX;
+            float centerY = downRight[1] + port * j + (float)rand() / RAND_MAX;
+            glm::vec2 center(centerX, centerY);
+            Triangle t = Triangle(center, width);
+            t.invMass = 1.0f;
+            tris.push_back(t);
+        }
+    }
+
+    //Base triangle
+    addBase(statics);
+    return width;
+}
+
+float buildPileScene(std::vector<Triangle> &tris,
+                     std::vector<Triangle> &statics, int count) {
+    srand(6);
+    // Same size as the default 80 x 80 scene
+    float width = 1000.0f / 80 / 3.0f;
+    // Side is sqrt(3) * width and height 3/2 * width. Pack slightly
+    // tighter than that so neighbours start touching.
+    float stepX = 1.7f * width;
+    float stepY = 1.45f * width;
+    int cols = (int)(1100.0f / stepX);
+    float left = -cols * stepX / 2.0f;
+    // bottom edge of the first row rests on the base at y = -530
+    float bottom = -530.0f + width / 2.0f;
+    tris.reserve(tris.size() + count);
+    for (int i = 0; i < count; i++) {
+        int row = i / cols;
+        int col = i % cols;
+        float centerX = left + stepX * col + (row % 2) * stepX / 2.0f
+            + 0.01f * (float)rand() / RAND_MAX;
+        float centerY = bottom + stepY * row;
+        glm::vec2 center(centerX, centerY);
+        Triangle t = Triangle(center, width);
+        t.invMass = 1.0f;
+        tris.push_back(t);
+    }
+
+    addBase(statics);
+    return width;
+}
+
+float buildCloudScene(std::vector<Triangle> &tris,
+                      std::vector<Triangle> &statics, int count) {
+    srand(8);
+    // Same size and density as the default 80 x 80 scene
+    float width = 1000.0f / 80 / 3.0f;
+    float side = sqrtf((float)count) * 1000.0f / 80;
+    tris.reserve(tris.size() + count);
+    for (int i = 0; i < count; i++) {
+        float centerX = side * ((float)rand() / RAND_MAX - 0.5f);
+        float centerY = -500.0f + side * (float)rand() / RAND_MAX;
+        glm::vec2 center(centerX, centerY);
+        Triangle t = Triangle(center, width);
+        t.velocity = glm::vec2(40.0f * rand() / RAND_MAX - 20.0f,
+                               40.0f * rand() / RAND_MAX - 20.0f);
+        t.rotationalVelocity = 200.0f * rand() / RAND_MAX - 100.0f;
+        t.invMass = 1.0f;
+        tris.push_back(t);
+    }
+
+    addBase(statics);
+    return width;
+}
+
+float buildMixedScene(std::vector<Triangle> &tris,
+                      std::vector<Triangle> &statics, int divs) {
+    srand(9);
+    glm::vec2 upLeft(-500.0f, 500.0f);
+    glm::vec2 downRight(500.0f, -500.0f);
+    float width = (downRight[0] - upLeft[0]) / divs / 3.0f;
+    float port = (downRight[0] - upLeft[0]) / divs;
+    for (int i = 0; i < divs; i++) {
+        for (int j = 0; j < divs; j++) {
+            float centerX = upLeft[0] + port * i + (float)rand() / RAND_MAX;
+            float centerY = downRight[1] + port * j + (float)rand() / RAND_MAX;
+            glm::vec2 center(centerX, centerY);
+            // Reaches past its neighbours' centres, so their boxes overlap
+            bool large = i % 3 == 1 && j % 3 == 1;
+            Triangle t = Triangle(center, large ? width * 2.5f : width);
+            t.invMass = 1.0f;
+            tris.push_back(t);
+        }
+    }
+
+    addBase(statics);
+    return width;
+}
+
+void addTerrain(std::vector<Triangle> &statics, int count,
+                float minWidth, float maxWidth, float rise) {
+    srand(7);
+    for (int i = 0; i < count; i++) {
+        float r = (float)rand() / RAND_MAX;
+        float width = minWidth + r * (maxWidth - minWidth);
+        // The top corner is width above the centre, the base top at -530
+        glm::vec2 center(-550.0f + 1100.0f * rand() / RAND_MAX,
+                         -530.0f - width + rise * rand() / RAND_MAX);
+        Triangle t = Triangle(center, width);
+        t.invMass = 0.0f;
+        statics.push_back(t);
+    }
+}
+
+int printTimestep(int framenum, std::ofstream * myfile,
+                  const std::vector<Triangle> &tris) {
+	std::ofstream &out = *myfile;
+	out << framenum;
+	for (unsigned int i = 0; i < tris.size(); i++) {
+        const glm::vec2 *v = tris[i].verts;
+        out << "\t" << v[0][0] << "," << v[0][1] << " " << v[1][0] << ","
+            << v[1][1] << " " << v[2][0] << "," << v[2][1];
+    }
+	out << "\n";
+	return 0;
+}
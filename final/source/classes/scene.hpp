@@ -0,0 +1,48 @@
+#ifndef __SCENE_H
+#define __SCENE_H
+
+#include <fstream>
+#include <vector>
+#include <glm.hpp>
+
+#include "triangle.hpp"
+#include "sceneFile.hpp"
+
+// Builds the default scene: a jittered divs x divs grid of falling
+// triangles and the large static base triangle they land on.
+// Returns the width used for the falling triangles.
+float buildDefaultScene(std::vector<Triangle> &tris,
+                        std::vector<Triangle> &statics, int divs);
+
+// Builds a pile of count triangles packed edge to edge on top of the same
+// base triangle so that nearly every body starts in contact.
+// Returns the width used for the triangles.
+float buildPileScene(std::vector<Triangle> &tris,
+                     std::vector<Triangle> &statics, int count);
+
+// Builds count triangles scattered at random over a square above the
+// base triangle, with random velocities and spins, at about the density
+// of the default scene. Returns the width used for the triangles.
+float buildCloudScene(std::vector<Triangle> &tris,
+                      std::vector<Triangle> &statics, int count);
+
+// Builds the default scene with every ninth triangle 2.5 times as wide,
+// larger than the triSize of width * 2 a Grid gets for it, so moving
+// bodies come in mixed sizes. Returns the width of the small triangles.
+float buildMixedScene(std::vector<Triangle> &tris,
+                      std::vector<Triangle> &statics, int divs);
+
+// Adds count static triangles of widths between minWidth and maxWidth,
+// standing in for terrain. They are sunk into the top of the base
+// triangle where piles rest, their tips sticking up by at most rise.
+void addTerrain(std::vector<Triangle> &statics, int count,
+                float minWidth, float maxWidth, float rise);
+
+// Funtion that prints to stdout or a file the state at each timestep.
+// Each line is the frame number then a tab before every body's
+// "x0,y0 x1,y1 x2,y2". Large runs should use a TrajectoryWriter and
+// convert with trajconv instead.
+int printTimestep(int framenum, std::ofstream * myfile,
+                  const std::vector<Triangle> &tris);
+
+#endif
@@ -0,0 +1,233 @@
+#include "sceneFile.hpp"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+
+#include "mappedFile.hpp"
+
+// Records written by saveSceneBinary per fwrite
+#define SCENE_WRITE_BATCH 4096
+
+// Every power of ten a double holds exactly
+static const double exactPowers[23] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+static inline bool isDigit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+static inline bool isBlank(char c) {
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+/*
+  Up to 15 significant digits fit a double exactly, and so does 10^e for
+  e up to 22, so one multiply or divide rounds the same way strtod does.
+  Anything longer goes to strtod on a copy of the number.
+ */
+bool parseFloat(const char *&p, const char *end, float &out) {
+    const char *s = p;
+    bool negative = false;
+    if (s < end && (*s == '-' || *s == '+')) {
+        negative = *s == '-';
+        s++;
+    }
+    unsigned long long mantissa = 0;
+    int digits = 0;
+    int exponent = 0;
+    bool any = false;
+    while (s < end && isDigit(*s)) {
+        if (digits < 19) {
+            mantissa = mantissa * 10 + (*s - '0');
+            digits += mantissa != 0;
+        } else {
+            digits++;
+            exponent++;
+        }
+        any = true;
+        s++;
+    }
+    if (s < end && *s == '.') {
+        s++;
+        while (s < end && isDigit(*s)) {
+            if (digits < 19) {
+                mantissa = mantissa * 10 + (*s - '0');
+                digits += mantissa != 0;
+                exponent--;
+            } else {
+                digits++;
+            }
+            any = true;
+            s++;
+        }
+    }
+    if (!any) {
+        return false;
+    }
+    // An 'e' without digits after it is not part of the number
+    if (s < end && (*s == 'e' || *s == 'E')) {
+        const char *e = s + 1;
+        bool negExp = false;
+        if (e < end && (*e == '-' || *e == '+')) {
+            negExp = *e == '-';
+            e++;
+        }
+        if (e < end && isDigit(*e)) {
+            int value = 0;
+            while (e < end && isDigit(*e)) {
+                if (value < 10000) {
+                    value = value * 10 + (*e - '0');
+                }
+                e++;
+            }
+            exponent += negExp ? -value : value;
+            s = e;
+        }
+    }
+
+    if (digits <= 15 && exponent >= -22 && exponent <= 22) {
+        double v = (double)mantissa;
+        v = exponent < 0 ? v / exactPowers[-exponent]
+            : v * exactPowers[exponent];
+        out = (float)(negative ? -v : v);
+    } else {
+        char buf[64];
+        unsigned int length = s - p;
+        if (length < sizeof(buf)) {
+            memcpy(buf, p, length);
+            buf[length] = '\0';
+            out = (float)strtod(buf, NULL);
+        } else {
+            out = (float)strtod(std::string(p, length).c_str(), NULL);
+        }
+    }
+    p = s;
+    return true;
+}
+
+static bool loadSceneText(const char *p, const char *end,
+                          std::vector<Triangle> &tris) {
+    // One body per line at most, so one pass over the newlines sizes
+    // the vector
+    unsigned int lines = 1;
+    for (const char *n = p; n < end;) {
+        n = (const char *)memchr(n, '\n', end - n);
+        if (n == NULL) {
+            break;
+        }
+        lines++;
+        n++;
+    }
+    unsigned int start = tris.size();
+    tris.reserve(start + lines);
+
+    while (p < end) {
+        while (p < end && isBlank(*p)) {
+            p++;
+        }
+        if (p == end) {
+            break;
+        }
+        if (*p == '\n') {
+            p++;
+            continue;
+        }
+        float v[3];
+        for (int i = 0; i < 3; i++) {
+            while (p < end && isBlank(*p)) {
+                p++;
+            }
+            if (!parseFloat(p, end, v[i])) {
+                tris.resize(start);
+                return false;
+            }
+        }
+        glm::vec2 center(v[0], v[1]);
+        Triangle t(center, v[2]);
+        t.invMass = 1.0f;
+        tris.push_back(t);
+        // Anything else on the line is ignored
+        const char *next = (const char *)memchr(p, '\n', end - p);
+        p = next != NULL ? next + 1 : end;
+    }
+    return true;
+}
+
+static bool loadSceneBinary(const unsigned char *data,
+                            unsigned long long size,
+                            std::vector<Triangle> &tris) {
+    SceneHeader header;
+    memcpy(&header, data, sizeof(header));
+    unsigned long long need = sizeof(header) +
+        (unsigned long long)header.count * sizeof(SceneBody);
+    if (header.version != SCENE_VERSION || need > size) {
+        return false;
+    }
+    unsigned int start = tris.size();
+    tris.resize(start + header.count);
+    const unsigned char *p = data + sizeof(header);
+    for (unsigned int i = 0; i < header.count; i++) {
+        SceneBody body;
+        memcpy(&body, p + (unsigned long long)i * sizeof(body), sizeof(body));
+        Triangle &t = tris[start + i];
+        for (int v = 0; v < 3; v++) {
+            t.verts[v] = glm::vec2(body.verts[2 * v], body.verts[2 * v + 1]);
+        }
+        t.velocity = glm::vec2(body.velX, body.velY);
+        t.rotationalVelocity = body.angVel;
+        t.invMass = body.invMass;
+    }
+    return true;
+}
+
+bool loadSceneFile(const char *file, std::vector<Triangle> &tris) {
+    MappedFile mapped;
+    if (!mapped.open(file)) {
+        return false;
+    }
+    if (mapped.size >= sizeof(SceneHeader) &&
+        memcmp(mapped.data, SCENE_MAGIC, 4) == 0) {
+        return loadSceneBinary(mapped.data, mapped.size, tris);
+    }
+    const char *text = (const char *)mapped.data;
+    return loadSceneText(text, text + mapped.size, tris);
+}
+
+bool saveSceneBinary(const char *file, const std::vector<Triangle> &tris) {
+    FILE *out = fopen(file, "wb");
+    if (out == NULL) {
+        return false;
+    }
+    SceneHeader header;
+    memcpy(header.magic, SCENE_MAGIC, 4);
+    header.version = SCENE_VERSION;
+    header.count = tris.size();
+    header.reserved = 0;
+    bool ok = fwrite(&header, sizeof(header), 1, out) == 1;
+
+    std::vector<SceneBody> batch;
+    batch.reserve(SCENE_WRITE_BATCH);
+    for (unsigned int i = 0; i < tris.size() && ok; i++) {
+        const Triangle &t = tris[i];
+        SceneBody body;
+        for (int v = 0; v < 3; v++) {
+            body.verts[2 * v] = t.verts[v][0];
+            body.verts[2 * v + 1] = t.verts[v][1];
+        }
+        body.velX = t.velocity[0];
+        body.velY = t.velocity[1];
+        body.angVel = t.rotationalVelocity;
+        body.invMass = t.invMass;
+        batch.push_back(body);
+        if (batch.size() == SCENE_WRITE_BATCH || i + 1 == tris.size()) {
+            ok = fwrite(&batch[0], sizeof(SceneBody), batch.size(), out)
+                == batch.size();
+            batch.clear();
+        }
+    }
+    return fclose(out) == 0 && ok;
+}
@@ -0,0 +1,48 @@
+#ifndef __SCENEFILE_H
+#define __SCENEFILE_H
+
+#include <vector>
+
+#include "triangle.hpp"
+
+/*
+  Scene files come in two forms. Text scenes have one "x y width" line
+  per body, each an equilateral triangle of that centre and centre to
+  corner width with a mass of 1. Binary scenes start with a SceneHeader
+  followed by count SceneBody records, which hold every field a Triangle
+  starts with, so loading them is a straight copy.
+ */
+
+#define SCENE_MAGIC "SCN1"
+#define SCENE_VERSION 1
+
+struct SceneHeader {
+    char magic[4];
+    unsigned int version;
+    unsigned int count;
+    unsigned int reserved;
+};
+
+struct SceneBody {
+    float verts[6];
+    float velX;
+    float velY;
+    float angVel;
+    float invMass;
+};
+
+// Appends the bodies of a text or binary scene file to tris, reserving
+// room for all of them first. Returns false if the file could not be
+// opened or is malformed, leaving tris as it was.
+bool loadSceneFile(const char *file, std::vector<Triangle> &tris);
+
+// Writes tris as a binary scene. Returns false if the file could not be
+// written.
+bool saveSceneBinary(const char *file, const std::vector<Triangle> &tris);
+
+// Reads a decimal float starting at p, no further than end, without
+// allocating. Gives the same value as atof. On success p is moved past
+// the number.
+bool parseFloat(const char *&p, const char *end, float &out);
+
+#endif
@@ -0,0 +1,63 @@
+#include "shapeRegistry.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#include "narrowphase.hpp"
+
+bool ShapeKey::operator<(const ShapeKey &other) const {
+    if (exponent != other.exponent) {
+        return exponent < other.exponent;
+    }
+    for (int i = 0; i < 6; i++) {
+        if (q[i] != other.q[i]) {
+            return q[i] < other.q[i];
+        }
+    }
+    return false;
+}
+
+unsigned int ShapeRegistry::size(void) const {
+    return radius.size();
+}
+
+/*
+  Coordinates are snapped to a power of two step below the shape's size,
+  so copies of a shape placed at different spots, whose local vertices
+  differ by rounding, usually land on the same key. A copy straddling a
+  step only costs an extra shape.
+ */
+unsigned int ShapeRegistry::find(const glm::vec2 *local) {
+    float extent = 0.0f;
+    for (int i = 0; i < 3; i++) {
+        extent = std::max(extent, std::max(std::fabs(local[i][0]),
+                                           std::fabs(local[i][1])));
+    }
+    ShapeKey key;
+    std::frexp(extent, &key.exponent);
+    float step = std::ldexp(1.0f, key.exponent - SHAPE_SNAP_BITS);
+    for (int i = 0; i < 3; i++) {
+        key.q[2 * i] = (long long)std::floor(local[i][0] / step + 0.5f);
+        key.q[2 * i + 1] = (long long)std::floor(local[i][1] / step + 0.5f);
+    }
+    std::map<ShapeKey, unsigned int>::iterator found = index.find(key);
+    if (found != index.end()) {
+        return found->second;
+    }
+
+    unsigned int shape = size();
+    glm::vec2 norms[3];
+    edgeNormals(local, glm::vec2(0.0f, 0.0f), norms);
+    float r = 0.0f;
+    for (int i = 0; i < 3; i++) {
+        vertX[i].push_back(local[i][0]);
+        vertY[i].push_back(local[i][1]);
+        normX[i].push_back(norms[i][0]);
+        normY[i].push_back(norms[i][1]);
+        r = std::max(r, glm::length(local[i]));
+    }
+    // A little slack so world vertices rounded outward stay inside
+    radius.push_back(r * 1.001f);
+    index[key] = shape;
+    return shape;
+}
@@ -0,0 +1,44 @@
+#ifndef __SHAPEREGISTRY_H
+#define __SHAPEREGISTRY_H
+
+#include <vector>
+#include <map>
+#include <glm.hpp>
+
+// Local vertices 1 / 2^SHAPE_SNAP_BITS of a shape's size apart or closer
+// count as the same shape
+#define SHAPE_SNAP_BITS 10
+
+// Local vertices of a shape snapped to a grid, for finding equal shapes
+struct ShapeKey {
+    int exponent;
+    long long q[6];
+    bool operator<(const ShapeKey &other) const;
+};
+
+/*
+  One entry per distinct triangle shape, with everything about it that
+  does not change as a body moves: vertices around the centroid and
+  outward unit edge normals at angle 0, and a radius around the
+  centroid that holds every vertex. Bodies refer to an entry by index
+  and carry only their position and rotation.
+ */
+class ShapeRegistry {
+public:
+    // One array per corner, or per edge starting at that corner
+    std::vector<float> vertX[3];
+    std::vector<float> vertY[3];
+    std::vector<float> normX[3];
+    std::vector<float> normY[3];
+    std::vector<float> radius;
+
+    unsigned int size(void) const;
+    // Index of the shape with these vertices around their centroid,
+    // adding it if new
+    unsigned int find(const glm::vec2 *local);
+
+private:
+    std::map<ShapeKey, unsigned int> index;
+};
+
+#endif
@@ -0,0 +1,179 @@
+#include "simThread.hpp"
+
+#include "timer.hpp"
+
+// A frame running this far behind its slot drops the backlog instead of
+// trying to catch up
+#define SIM_MAX_LAG 0.25
+
+SnapshotBuffer::SnapshotBuffer(void) {
+    write = 0;
+    ready = 1;
+    cur = 2;
+    prev = 3;
+    fresh = false;
+    for (int i = 0; i < 4; i++) {
+        slots[i].frame = 0;
+        slots[i].simTime = 0.0;
+        slots[i].wallTime = 0.0;
+        slots[i].totalEngineTime = 0.0;
+        slots[i].lastSubstepTime = 0.0;
+        slots[i].substeps = 0;
+        slots[i].stepTime = 0.0f;
+    }
+    pthread_mutex_init(&lock, NULL);
+}
+
+SnapshotBuffer::~SnapshotBuffer(void) {
+    pthread_mutex_destroy(&lock);
+}
+
+BodySnapshot &SnapshotBuffer::back(void) {
+    return slots[write];
+}
+
+void SnapshotBuffer::publish(void) {
+    pthread_mutex_lock(&lock);
+    int t = ready;
+    ready = write;
+    write = t;
+    fresh = true;
+    pthread_mutex_unlock(&lock);
+}
+
+bool SnapshotBuffer::acquire(void) {
+    pthread_mutex_lock(&lock);
+    bool got = fresh;
+    if (fresh) {
+        // The old previous becomes the spare ready slot
+        int t = prev;
+        prev = cur;
+        cur = ready;
+        ready = t;
+        fresh = false;
+    }
+    pthread_mutex_unlock(&lock);
+    return got;
+}
+
+const BodySnapshot &SnapshotBuffer::previous(void) const {
+    return slots[prev];
+}
+
+const BodySnapshot &SnapshotBuffer::current(void) const {
+    return slots[cur];
+}
+
+SimThread::SimThread(Grid &gr, float step, int steps, double rate)
+    : grid(gr) {
+    stepTime = step;
+    substeps = steps;
+    frameRate = rate;
+    hook = NULL;
+    hookData = NULL;
+    controller = NULL;
+    started = false;
+    quit = false;
+    alive = false;
+}
+
+SimThread::~SimThread(void) {
+    stop();
+}
+
+void SimThread::start(void) {
+    if (started) {
+        return;
+    }
+    quit = false;
+    alive = true;
+    started = true;
+    pthread_create(&thread, NULL, threadMain, this);
+}
+
+void SimThread::stop(void) {
+    if (!started) {
+        return;
+    }
+    quit = true;
+    pthread_join(thread, NULL);
+    started = false;
+}
+
+bool SimThread::running(void) const {
+    return alive;
+}
+
+void *SimThread::threadMain(void *input) {
+    ((SimThread *)input)->run();
+    return NULL;
+}
+
+void SimThread::capture(BodySnapshot &snap) {
+    BodyStore &bodies = grid.bodies;
+    unsigned int count = bodies.size();
+    snap.midX.resize(count);
+    snap.midY.resize(count);
+    snap.angle.resize(count);
+    snap.shape.resize(count);
+    for (unsigned int id = 0; id < count; id++) {
+        unsigned int slot = bodies.slotOf[id];
+        snap.midX[id] = bodies.midX[slot];
+        snap.midY[id] = bodies.midY[slot];
+        snap.angle[id] = bodies.angle[slot];
+        snap.shape[id] = bodies.shape[slot];
+    }
+}
+
+void SimThread::run(void) {
+    unsigned int frame = 0;
+    double simTime = 0.0;
+    double totalEngine = 0.0;
+    double next = getTime();
+    while (!quit) {
+        if (frameRate > 0.0) {
+            sleepFor(next - getTime());
+            next += 1.0 / frameRate;
+            if (getTime() - next > SIM_MAX_LAG) {
+                next = getTime();
+            }
+        }
+
+        double beg = getTime();
+        int steps = substeps;
+        float step = stepTime;
+        if (controller != NULL) {
+            controller->plan(grid);
+            steps = controller->substeps;
+            step = controller->stepTime;
+        }
+        double mid = beg;
+        for (int i = 0; i < steps; i++) {
+            mid = getTime();
+            grid.substep(step);
+            if (controller != NULL) {
+                controller->observe(grid);
+            }
+        }
+        double end = getTime();
+        frame++;
+        simTime += steps * step;
+        totalEngine += end - beg;
+
+        BodySnapshot &snap = snapshots.back();
+        capture(snap);
+        snap.frame = frame;
+        snap.simTime = simTime;
+        snap.substeps = steps;
+        snap.stepTime = step;
+        snap.totalEngineTime = totalEngine;
+        snap.lastSubstepTime = end - mid;
+        snap.wallTime = getTime();
+        snapshots.publish();
+
+        if (hook != NULL && !hook(grid, frame, hookData)) {
+            break;
+        }
+    }
+    alive = false;
+}
@@ -0,0 +1,110 @@
+#ifndef __SIMTHREAD_H
+#define __SIMTHREAD_H
+
+#include <vector>
+#include <atomic>
+
+#include "pthread.h"
+#include "grid.hpp"
+#include "stepController.hpp"
+
+// Body transforms at the end of one simulated frame, in body id order so
+// two snapshots line up whatever sorting happened in between
+struct BodySnapshot {
+    // 0 until the first frame has been published
+    unsigned int frame;
+    // Simulated seconds, and getTime() when the frame was published
+    double simTime;
+    double wallTime;
+    // Seconds spent in all frames up to this one, and in the last
+    // substep of this one
+    double totalEngineTime;
+    double lastSubstepTime;
+    // Substeps this frame was split into and their length
+    int substeps;
+    float stepTime;
+
+    std::vector<float> midX;
+    std::vector<float> midY;
+    std::vector<float> angle;
+    std::vector<unsigned int> shape;
+};
+
+/*
+  Hands snapshots from the simulation thread to the render thread. The
+  producer always has a slot of its own to write, so it never waits on
+  drawing; publish swaps it with the ready slot. acquire moves the ready
+  slot to current and current to previous so the reader can interpolate
+  between the two. Frames published faster than they are acquired are
+  dropped.
+ */
+class SnapshotBuffer {
+public:
+    SnapshotBuffer(void);
+    ~SnapshotBuffer(void);
+
+    // Producer side
+    BodySnapshot &back(void);
+    void publish(void);
+
+    // Reader side. Returns true if a newer snapshot became current.
+    bool acquire(void);
+    const BodySnapshot &previous(void) const;
+    const BodySnapshot &current(void) const;
+
+private:
+    BodySnapshot slots[4];
+    int write;
+    int ready;
+    int cur;
+    int prev;
+    bool fresh;
+    pthread_mutex_t lock;
+};
+
+// Called on the simulation thread after every frame. Returning false
+// stops the simulation.
+typedef bool (*FrameHook)(Grid &grid, unsigned int frame, void *data);
+
+/*
+  Runs a Grid on its own thread in frames of substeps steps of stepTime,
+  or as many as controller picks to fill the same time, frameRate frames
+  per second of wall time (0 runs flat out). After
+  every frame the body transforms go into snapshots, so drawing never
+  holds up the simulation and the display rate never sets its pace.
+  Nothing else may touch the grid's bodies while it runs.
+ */
+class SimThread {
+public:
+    SnapshotBuffer snapshots;
+    FrameHook hook;
+    void *hookData;
+    // If set, picks the substeps of each frame. Not owned.
+    StepController *controller;
+
+    SimThread(Grid &grid, float stepTime, int substeps, double frameRate);
+    ~SimThread(void);
+
+    void start(void);
+    // Finishes the frame in progress and joins the thread
+    void stop(void);
+    // False once stopped, or once the hook asked to stop
+    bool running(void) const;
+
+    static void *threadMain(void *input);
+
+private:
+    Grid &grid;
+    float stepTime;
+    int substeps;
+    double frameRate;
+    pthread_t thread;
+    bool started;
+    std::atomic<bool> quit;
+    std::atomic<bool> alive;
+
+    void run(void);
+    void capture(BodySnapshot &snap);
+};
+
+#endif
@@ -0,0 +1,74 @@
+#ifndef __SIMD_H
+#define __SIMD_H
+
+/*
+  Thin wrappers over SSE or AVX registers so batched kernels are written
+  once. SIMD_LANES is the number of floats per register. Builds without
+  SSE, or with PHYSICS_NO_SIMD defined, get SIMD_LANES 1 and callers use
+  their scalar code instead. Arguments go by reference because 32 bit
+  MSVC cannot pass aligned types by value.
+ */
+
+#if !defined(PHYSICS_NO_SIMD) && defined(__AVX__)
+
+#include <immintrin.h>
+#define SIMD_LANES 8
+typedef __m256 vfloat;
+
+inline vfloat vset(float f) { return _mm256_set1_ps(f); }
+inline vfloat vload(const float *p) { return _mm256_loadu_ps(p); }
+inline void vstore(float *p, const vfloat &a) { _mm256_storeu_ps(p, a); }
+inline vfloat vadd(const vfloat &a, const vfloat &b) { return _mm256_add_ps(a, b); }
+inline vfloat vsub(const vfloat &a, const vfloat &b) { return _mm256_sub_ps(a, b); }
+inline vfloat vmul(const vfloat &a, const vfloat &b) { return _mm256_mul_ps(a, b); }
+inline vfloat vdiv(const vfloat &a, const vfloat &b) { return _mm256_div_ps(a, b); }
+inline vfloat vsqrt(const vfloat &a) { return _mm256_sqrt_ps(a); }
+inline vfloat vmin(const vfloat &a, const vfloat &b) { return _mm256_min_ps(a, b); }
+inline vfloat vmax(const vfloat &a, const vfloat &b) { return _mm256_max_ps(a, b); }
+inline vfloat vgt(const vfloat &a, const vfloat &b) { return _mm256_cmp_ps(a, b, _CMP_GT_OQ); }
+inline vfloat vlt(const vfloat &a, const vfloat &b) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+inline vfloat vneq(const vfloat &a, const vfloat &b) { return _mm256_cmp_ps(a, b, _CMP_NEQ_UQ); }
+inline vfloat vand(const vfloat &a, const vfloat &b) { return _mm256_and_ps(a, b); }
+inline vfloat vor(const vfloat &a, const vfloat &b) { return _mm256_or_ps(a, b); }
+inline vfloat vandnot(const vfloat &a, const vfloat &b) { return _mm256_andnot_ps(a, b); }
+inline int vmask(const vfloat &a) { return _mm256_movemask_ps(a); }
+
+#elif !defined(PHYSICS_NO_SIMD) && (defined(__SSE__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 1))
+
+#include <xmmintrin.h>
+#define SIMD_LANES 4
+typedef __m128 vfloat;
+
+inline vfloat vset(float f) { return _mm_set1_ps(f); }
+inline vfloat vload(const float *p) { return _mm_loadu_ps(p); }
+inline void vstore(float *p, const vfloat &a) { _mm_storeu_ps(p, a); }
+inline vfloat vadd(const vfloat &a, const vfloat &b) { return _mm_add_ps(a, b); }
+inline vfloat vsub(const vfloat &a, const vfloat &b) { return _mm_sub_ps(a, b); }
+inline vfloat vmul(const vfloat &a, const vfloat &b) { return _mm_mul_ps(a, b); }
+inline vfloat vdiv(const vfloat &a, const vfloat &b) { return _mm_div_ps(a, b); }
+inline vfloat vsqrt(const vfloat &a) { return _mm_sqrt_ps(a); }
+inline vfloat vmin(const vfloat &a, const vfloat &b) { return _mm_min_ps(a, b); }
+inline vfloat vmax(const vfloat &a, const vfloat &b) { return _mm_max_ps(a, b); }
+inline vfloat vgt(const vfloat &a, const vfloat &b) { return _mm_cmpgt_ps(a, b); }
+inline vfloat vlt(const vfloat &a, const vfloat &b) { return _mm_cmplt_ps(a, b); }
+inline vfloat vneq(const vfloat &a, const vfloat &b) { return _mm_cmpneq_ps(a, b); }
+inline vfloat vand(const vfloat &a, const vfloat &b) { return _mm_and_ps(a, b); }
+inline vfloat vor(const vfloat &a, const vfloat &b) { return _mm_or_ps(a, b); }
+inline vfloat vandnot(const vfloat &a, const vfloat &b) { return _mm_andnot_ps(a, b); }
+inline int vmask(const vfloat &a) { return _mm_movemask_ps(a); }
+
+#else
+
+#define SIMD_LANES 1
+
+#endif
+
+#if SIMD_LANES > 1
+// Lanes of mask set take b, the rest take a
+inline vfloat vselect(const vfloat &mask, const vfloat &a, const vfloat &b) {
+    return vor(vand(mask, b), vandnot(mask, a));
+}
+#endif
+
+#endif
@@ -0,0 +1,100 @@
+#include "stepController.hpp"
+
+#include <math.h>
+#include <algorithm>
+
+#include "narrowphase.hpp"
+
+StepController::StepController(float frame) {
+    frameTime = frame;
+    baseStep = 0.0005f;
+    baseDrag = 0.9995f;
+    minStep = baseStep;
+    maxStep = 0.0025f;
+    maxTravel = 0.02f;
+    springSteps = 16.0f;
+    depthLimit = 0.25f;
+    growth = 1.25f;
+
+    stepTime = baseStep;
+    substeps = (int)ceil(frameTime / baseStep - 0.001f);
+    speedStep = maxStep;
+    springStep = maxStep;
+    depthStep = maxStep;
+    maxSpeed = 0.0f;
+    maxDepth = 0.0f;
+}
+
+void StepController::plan(Grid &grid) {
+    BodyStore &bodies = grid.bodies;
+    // Spin is in degrees a second, the tips are at most triSize / 2 out
+    float tip = 3.14159265f / 180.0f * grid.triSize * 0.5f;
+    float fastest = 0.0f;
+    float lightest = 0.0f;
+    for (unsigned int i = 0; i < bodies.moving.size(); i++) {
+        unsigned int slot = bodies.moving[i];
+        float speed = sqrt(bodies.velX[slot] * bodies.velX[slot] +
+                           bodies.velY[slot] * bodies.velY[slot]) +
+            fabs(bodies.angVel[slot]) * tip;
+        fastest = std::max(fastest, speed);
+        lightest = std::max(lightest, bodies.invMass[slot]);
+    }
+    maxSpeed = fastest;
+
+    speedStep = maxStep;
+    if (fastest > 0.0f) {
+        speedStep = maxTravel * grid.triSize / fastest;
+    }
+    // An impulse of HOOKE_CONSTANT * depth every baseStep is a spring of
+    // HOOKE_CONSTANT / baseStep
+    springStep = maxStep;
+    if (lightest > 0.0f) {
+        float omega = sqrt(HOOKE_CONSTANT * lightest / baseStep);
+        springStep = 2.0f * 3.14159265f / omega / springSteps;
+    }
+    depthStep = maxStep;
+    if (maxDepth > 0.0f) {
+        depthStep = stepTime * depthLimit * grid.triSize / maxDepth;
+    }
+
+    // Growing may always drop at least one substep
+    float grown = stepTime * growth;
+    if (substeps > 1) {
+        grown = std::max(grown, frameTime / (substeps - 1));
+    }
+    float step = std::min(std::min(speedStep, springStep),
+                          std::min(depthStep, grown));
+    step = std::min(std::max(step, minStep), maxStep);
+    // Round to a whole number of substeps, never longer than step
+    substeps = (int)ceil(frameTime / step - 0.001f);
+    substeps = std::max(substeps, 1);
+    stepTime = frameTime / substeps;
+    maxDepth = 0.0f;
+
+    float scale = stepTime / baseStep;
+    if (fabs(scale - 1.0f) < 0.0001f) {
+        stepTime = baseStep;
+        scale = 1.0f;
+    }
+    grid.contactScale = scale;
+    grid.bodies.drag = scale == 1.0f ? baseDrag : pow(baseDrag, scale);
+}
+
+void StepController::observe(Grid &grid) {
+    // SAT against a static as large as the base measures overlap along
+    // the body's own axes too, so only contacts between bodies count
+    for (unsigned int p = 0; p < grid.contacts.size(); p++) {
+        const Contact &c = grid.contacts[p];
+        if (c.hit && !grid.pairs[p].isStatic) {
+            maxDepth = std::max(maxDepth, c.depth);
+        }
+    }
+}
+
+void StepController::frame(Grid &grid) {
+    plan(grid);
+    for (int i = 0; i < substeps; i++) {
+        grid.substep(stepTime);
+        observe(grid);
+    }
+}
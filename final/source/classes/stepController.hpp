@@ -0,0 +1,66 @@
+#ifndef __STEPCONTROLLER_H
+#define __STEPCONTROLLER_H
+
+#include "grid.hpp"
+
+/*
+  Picks how many substeps each frame of frameTime simulated seconds is
+  split into. Before a frame the step is bounded by:
+
+  - speed: the fastest body, spin included, moves at most maxTravel of
+    triSize in one step
+  - springs: the stiffest contact spring, HOOKE_CONSTANT over the
+    lightest body, gets springSteps steps per oscillation
+  - penetration: the step is scaled by depthLimit over the deepest
+    contact of the last frame, so it shrinks while bodies sink into
+    each other and grows back when they do not, by at most growth or
+    one substep a frame
+
+  then clamped to [minStep, maxStep] and rounded down so a whole number
+  of substeps fills the frame. Calm frames run fewer, longer steps.
+
+  Contact impulses and air drag are applied once per substep and were
+  sized for steps of baseStep, so plan scales both to the chosen step
+  through Grid::contactScale and BodyStore::drag. A step of exactly
+  baseStep runs as if there were no controller.
+ */
+class StepController {
+public:
+    // Simulated seconds in a frame, and the step contacts are sized for
+    float frameTime;
+    float baseStep;
+    // Velocity kept each baseStep step, BodyStore's default drag
+    float baseDrag;
+    // Bounds on the step. minStep starts at baseStep, the fixed step the
+    // engine was tuned with.
+    float minStep;
+    float maxStep;
+    float maxTravel;
+    float springSteps;
+    // Deepest contact between bodies wanted, in triSize
+    float depthLimit;
+    float growth;
+
+    // Chosen for the frame being run
+    float stepTime;
+    int substeps;
+    // Limits plan worked out, before clamping
+    float speedStep;
+    float springStep;
+    float depthStep;
+    // Fastest body when the frame was planned, and deepest contact seen
+    // since
+    float maxSpeed;
+    float maxDepth;
+
+    StepController(float frameTime);
+
+    // Picks stepTime and substeps for the next frame of grid
+    void plan(Grid &grid);
+    // Call after every substep of the frame
+    void observe(Grid &grid);
+    // plan, then the substeps, each observed
+    void frame(Grid &grid);
+};
+
+#endif
@@ -0,0 +1,154 @@
+#include "sweepPrune.hpp"
+
+#include <algorithm>
+
+static inline bool isMax(const Endpoint &e) {
+    return (e.id & 1) != 0;
+}
+
+// Order ends by value. On a tie min ends go first so touching boxes
+// count as overlapping, the same as BodyStore::aabbOverlap
+static inline bool endLess(const Endpoint &a, const Endpoint &b) {
+    return a.value < b.value ||
+        (a.value == b.value && !isMax(a) && isMax(b));
+}
+
+static inline unsigned long long pairKey(unsigned int a, unsigned int b) {
+    if (a < b) {
+        std::swap(a, b);
+    }
+    return ((unsigned long long)a << 32) | b;
+}
+
+// Refresh the values of ends along one axis from the box arrays
+static void refreshEnds(std::vector<Endpoint> &ends,
+                        std::vector<float> &mins, std::vector<float> &maxs) {
+    for (unsigned int i = 0; i < ends.size(); i++) {
+        unsigned int slot = ends[i].id >> 1;
+        ends[i].value = isMax(ends[i]) ? maxs[slot] : mins[slot];
+    }
+}
+
+SweepPrune::SweepPrune(void) {
+    swaps = 0;
+    tests = 0;
+}
+
+void SweepPrune::build(BodyStore &bodies) {
+    unsigned int count = bodies.size();
+    endsX.resize(2 * count);
+    endsY.resize(2 * count);
+    for (unsigned int i = 0; i < count; i++) {
+        endsX[2 * i].id = i << 1;
+        endsX[2 * i + 1].id = (i << 1) | 1;
+    }
+    endsY = endsX;
+    refreshEnds(endsX, bodies.minX, bodies.maxX);
+    refreshEnds(endsY, bodies.minY, bodies.maxY);
+    std::sort(endsX.begin(), endsX.end(), endLess);
+    std::sort(endsY.begin(), endsY.end(), endLess);
+
+    pairs.clear();
+    pairIndex.clear();
+    swaps = 0;
+    tests = 0;
+
+    // Sweep x keeping the bodies whose x range is open
+    std::vector<unsigned int> active;
+    for (unsigned int i = 0; i < endsX.size(); i++) {
+        unsigned int slot = endsX[i].id >> 1;
+        if (isMax(endsX[i])) {
+            for (unsigned int k = 0; k < active.size(); k++) {
+                if (active[k] == slot) {
+                    active[k] = active.back();
+                    active.pop_back();
+                    break;
+                }
+            }
+            continue;
+        }
+        for (unsigned int k = 0; k < active.size(); k++) {
+            tests++;
+            if (bodies.aabbOverlap(slot, bodies, active[k])) {
+                addPair(slot, active[k]);
+            }
+        }
+        active.push_back(slot);
+    }
+}
+
+void SweepPrune::update(BodyStore &bodies) {
+    if (endsX.size() != 2 * bodies.size()) {
+        build(bodies);
+        return;
+    }
+    swaps = 0;
+    tests = 0;
+    refreshEnds(endsX, bodies.minX, bodies.maxX);
+    refreshEnds(endsY, bodies.minY, bodies.maxY);
+    sortAxis(endsX, bodies);
+    sortAxis(endsY, bodies);
+}
+
+/*
+  Insertion sort of one axis. When a min end moves below a max end the
+  two boxes start to overlap on this axis, so the pair is added if they
+  overlap on the other one too. When a max end moves below a min end
+  they stop overlapping and the pair goes.
+ */
+void SweepPrune::sortAxis(std::vector<Endpoint> &ends, BodyStore &bodies) {
+    for (unsigned int i = 1; i < ends.size(); i++) {
+        Endpoint e = ends[i];
+        unsigned int j = i;
+        while (j > 0 && endLess(e, ends[j - 1])) {
+            Endpoint &prev = ends[j - 1];
+            bool eMax = isMax(e);
+            if (eMax != isMax(prev)) {
+                unsigned int a = e.id >> 1;
+                unsigned int b = prev.id >> 1;
+                if (!eMax) {
+                    tests++;
+                    if (bodies.aabbOverlap(a, bodies, b)) {
+                        addPair(a, b);
+                    }
+                } else {
+                    removePair(a, b);
+                }
+            }
+            ends[j] = prev;
+            j--;
+            swaps++;
+        }
+        ends[j] = e;
+    }
+}
+
+void SweepPrune::addPair(unsigned int a, unsigned int b) {
+    unsigned long long key = pairKey(a, b);
+    if (pairIndex.find(key) != pairIndex.end()) {
+        return;
+    }
+    pairIndex[key] = pairs.size();
+    BodyPair pair;
+    pair.a = std::max(a, b);
+    pair.b = std::min(a, b);
+    pair.isStatic = false;
+    pairs.push_back(pair);
+}
+
+void SweepPrune::removePair(unsigned int a, unsigned int b) {
+    std::unordered_map<unsigned long long, unsigned int>::iterator it =
+        pairIndex.find(pairKey(a, b));
+    if (it == pairIndex.end()) {
+        return;
+    }
+    // Fill the hole with the last pair
+    unsigned int index = it->second;
+    pairIndex.erase(it);
+    BodyPair last = pairs.back();
+    pairs.pop_back();
+    if (index < pairs.size()) {
+        pairs[index] = last;
+        pairIndex[pairKey(last.a, last.b)] = index;
+    }
+}
@@ -0,0 +1,50 @@
+#ifndef __SWEEPPRUNE_H
+#define __SWEEPPRUNE_H
+
+#include <vector>
+#include <unordered_map>
+
+#include "bodyStore.hpp"
+#include "narrowphase.hpp"
+
+// One end of a body's box along an axis
+struct Endpoint {
+    float value;
+    // slot << 1, low bit set for the max end
+    unsigned int id;
+};
+
+/*
+  Incremental sweep and prune. Box ends along x and y stay sorted
+  between substeps and are fixed up with an insertion sort, so the work
+  is the number of ends that passed each other. The set of overlapping
+  pairs only changes when a min end passes a max end. Bodies are held
+  by slot, so the store must not be permuted while this is in use.
+ */
+class SweepPrune {
+public:
+    std::vector<Endpoint> endsX;
+    std::vector<Endpoint> endsY;
+    // Every overlapping pair of moving bodies, higher slot first
+    std::vector<BodyPair> pairs;
+    // Position in pairs of each pair key
+    std::unordered_map<unsigned long long, unsigned int> pairIndex;
+
+    // End swaps and bounding box tests done by the last update
+    unsigned long long swaps;
+    unsigned long long tests;
+
+    SweepPrune(void);
+
+    // Sort the ends from scratch and find every overlap
+    void build(BodyStore &bodies);
+    // Move the ends to the bodies' current boxes and update pairs
+    void update(BodyStore &bodies);
+
+private:
+    void sortAxis(std::vector<Endpoint> &ends, BodyStore &bodies);
+    void addPair(unsigned int a, unsigned int b);
+    void removePair(unsigned int a, unsigned int b);
+};
+
+#endif
@@ -0,0 +1,266 @@
+#include "taskPool.hpp"
+
+#include "sched.h"
+#include "timer.hpp"
+
+int TaskGraph::add(const char *name, TaskRun run, TaskCount count, void *data,
+                   unsigned int grain) {
+    Task task;
+    task.name = name;
+    task.run = run;
+    task.count = count;
+    task.data = data;
+    task.grain = grain > 0 ? grain : 1;
+    task.numDeps = 0;
+    task.wall = 0.0;
+    task.busy = 0.0;
+    task.chunks = 0;
+    task.runs = 0;
+    tasks.push_back(task);
+    return tasks.size() - 1;
+}
+
+void TaskGraph::depend(int task, int before) {
+    tasks[before].dependents.push_back(task);
+    tasks[task].numDeps++;
+}
+
+void TaskGraph::resetStats(void) {
+    for (unsigned int t = 0; t < tasks.size(); t++) {
+        tasks[t].wall = 0.0;
+        tasks[t].busy = 0.0;
+        tasks[t].chunks = 0;
+        tasks[t].runs = 0;
+    }
+}
+
+// Holds worker index + 1 for every thread a pool has run on
+static pthread_key_t workerKey;
+static pthread_once_t workerKeyOnce = PTHREAD_ONCE_INIT;
+
+static void makeWorkerKey(void) {
+    pthread_key_create(&workerKey, NULL);
+}
+
+static void setWorker(int index) {
+    pthread_setspecific(workerKey, (void *)(size_t)(index + 1));
+}
+
+int TaskPool::currentWorker(void) {
+    pthread_once(&workerKeyOnce, makeWorkerKey);
+    return (int)(size_t)pthread_getspecific(workerKey) - 1;
+}
+
+TaskPool::TaskPool(int threads) {
+    if (threads < 1) {
+        threads = 1;
+    }
+    graph = NULL;
+    chunksLeft = NULL;
+    depsLeft = NULL;
+    graphSize = 0;
+    steals = 0;
+    tasksLeft = 0;
+    stealCount = 0;
+    generation = 0;
+    quit = false;
+    pthread_once(&workerKeyOnce, makeWorkerKey);
+    pthread_mutex_init(&wakeLock, NULL);
+    pthread_cond_init(&wakeCond, NULL);
+    for (int i = 0; i < threads; i++) {
+        TaskWorker *worker = new TaskWorker();
+        worker->pool = this;
+        worker->index = i;
+        pthread_mutex_init(&worker->lock, NULL);
+        workers.push_back(worker);
+    }
+    // Worker 0 is whoever calls run
+    for (int i = 1; i < threads; i++) {
+        pthread_create(&workers[i]->thread, NULL, workerMain, workers[i]);
+    }
+}
+
+TaskPool::~TaskPool(void) {
+    pthread_mutex_lock(&wakeLock);
+    quit = true;
+    pthread_cond_broadcast(&wakeCond);
+    pthread_mutex_unlock(&wakeLock);
+    for (unsigned int i = 1; i < workers.size(); i++) {
+        pthread_join(workers[i]->thread, NULL);
+    }
+    for (unsigned int i = 0; i < workers.size(); i++) {
+        pthread_mutex_destroy(&workers[i]->lock);
+        delete workers[i];
+    }
+    pthread_cond_destroy(&wakeCond);
+    pthread_mutex_destroy(&wakeLock);
+    delete [] chunksLeft;
+    delete [] depsLeft;
+}
+
+int TaskPool::size(void) {
+    return workers.size();
+}
+
+void *TaskPool::workerMain(void *input) {
+    TaskWorker *worker = (TaskWorker *)input;
+    TaskPool *pool = worker->pool;
+    setWorker(worker->index);
+    unsigned int seen = 0;
+    while (true) {
+        pthread_mutex_lock(&pool->wakeLock);
+        while (pool->generation == seen && !pool->quit) {
+            pthread_cond_wait(&pool->wakeCond, &pool->wakeLock);
+        }
+        seen = pool->generation;
+        bool quit = pool->quit;
+        pthread_mutex_unlock(&pool->wakeLock);
+        if (quit) {
+            break;
+        }
+        pool->work(*worker);
+    }
+    return NULL;
+}
+
+void TaskPool::run(TaskGraph &g) {
+    unsigned int count = g.tasks.size();
+    if (count == 0) {
+        return;
+    }
+    if (count != graphSize) {
+        delete [] chunksLeft;
+        delete [] depsLeft;
+        chunksLeft = new std::atomic<int>[count];
+        depsLeft = new std::atomic<int>[count];
+        graphSize = count;
+    }
+    graph = &g;
+    readyTime.assign(count, 0.0);
+    for (unsigned int t = 0; t < count; t++) {
+        chunksLeft[t] = 0;
+        depsLeft[t] = g.tasks[t].numDeps;
+    }
+    for (unsigned int i = 0; i < workers.size(); i++) {
+        workers[i]->busy.assign(count, 0.0);
+    }
+    stealCount = 0;
+    tasksLeft = count;
+
+    // Queue the roots before waking anyone so there is work to find
+    TaskWorker &self = *workers[0];
+    setWorker(0);
+    for (unsigned int t = 0; t < count; t++) {
+        if (g.tasks[t].numDeps == 0) {
+            ready(self, t);
+        }
+    }
+    pthread_mutex_lock(&wakeLock);
+    generation++;
+    pthread_cond_broadcast(&wakeCond);
+    pthread_mutex_unlock(&wakeLock);
+
+    work(self);
+
+    for (unsigned int t = 0; t < count; t++) {
+        double busy = 0.0;
+        for (unsigned int i = 0; i < workers.size(); i++) {
+            busy += workers[i]->busy[t];
+        }
+        g.tasks[t].busy += busy;
+        g.tasks[t].runs++;
+    }
+    steals = stealCount;
+}
+
+// Keep taking chunks until every task of the run is done
+void TaskPool::work(TaskWorker &worker) {
+    TaskJob job;
+    while (tasksLeft > 0) {
+        if (popJob(worker, job) || stealJob(worker, job)) {
+            execute(worker, job);
+        } else {
+            sched_yield();
+        }
+    }
+}
+
+bool TaskPool::popJob(TaskWorker &worker, TaskJob &job) {
+    bool found = false;
+    pthread_mutex_lock(&worker.lock);
+    if (!worker.jobs.empty()) {
+        job = worker.jobs.back();
+        worker.jobs.pop_back();
+        found = true;
+    }
+    pthread_mutex_unlock(&worker.lock);
+    return found;
+}
+
+bool TaskPool::stealJob(TaskWorker &worker, TaskJob &job) {
+    unsigned int count = workers.size();
+    for (unsigned int i = 1; i < count; i++) {
+        TaskWorker &victim = *workers[(worker.index + i) % count];
+        bool found = false;
+        pthread_mutex_lock(&victim.lock);
+        if (!victim.jobs.empty()) {
+            job = victim.jobs.front();
+            victim.jobs.pop_front();
+            found = true;
+        }
+        pthread_mutex_unlock(&victim.lock);
+        if (found) {
+            stealCount++;
+            return true;
+        }
+    }
+    return false;
+}
+
+void TaskPool::execute(TaskWorker &worker, TaskJob &job) {
+    Task &task = graph->tasks[job.task];
+    double beg = getTime();
+    task.run(task.data, job.begin, job.end);
+    worker.busy[job.task] += getTime() - beg;
+    if (--chunksLeft[job.task] == 0) {
+        finish(worker, job.task);
+    }
+}
+
+// All dependencies of task are done, split it into chunks
+void TaskPool::ready(TaskWorker &worker, int t) {
+    Task &task = graph->tasks[t];
+    readyTime[t] = getTime();
+    unsigned int items = task.count != NULL ? task.count(task.data) : 1;
+    if (items == 0) {
+        finish(worker, t);
+        return;
+    }
+    unsigned int chunks = (items + task.grain - 1) / task.grain;
+    task.chunks += chunks;
+    // Set before any chunk can run and finish
+    chunksLeft[t] = chunks;
+    pthread_mutex_lock(&worker.lock);
+    // Pushed in reverse so the owner takes them front to back
+    for (unsigned int c = chunks; c > 0; c--) {
+        TaskJob job;
+        job.task = t;
+        job.begin = (c - 1) * task.grain;
+        job.end = job.begin + task.grain < items ? job.begin + task.grain
+            : items;
+        worker.jobs.push_back(job);
+    }
+    pthread_mutex_unlock(&worker.lock);
+}
+
+void TaskPool::finish(TaskWorker &worker, int t) {
+    Task &task = graph->tasks[t];
+    task.wall += getTime() - readyTime[t];
+    for (unsigned int d = 0; d < task.dependents.size(); d++) {
+        int next = task.dependents[d];
+        if (--depsLeft[next] == 0) {
+            ready(worker, next);
+        }
+    }
+    tasksLeft--;
+}
@@ -0,0 +1,125 @@
+#ifndef __TASKPOOL_H
+#define __TASKPOOL_H
+
+#include <vector>
+#include <deque>
+#include <atomic>
+
+#include "pthread.h"
+
+// Runs items [begin, end) of a task
+typedef void (*TaskRun)(void *data, unsigned int begin, unsigned int end);
+// Number of items in a task, asked once the task's dependencies are done
+typedef unsigned int (*TaskCount)(void *data);
+
+// One node of a TaskGraph
+struct Task {
+    const char *name;
+    TaskRun run;
+    // NULL for a task with a single item
+    TaskCount count;
+    void *data;
+    // Items per chunk, each chunk is one unit of work for the pool
+    unsigned int grain;
+    // Tasks waiting on this one
+    std::vector<int> dependents;
+    int numDeps;
+
+    // Timings summed over runs since resetStats, in seconds. wall is from
+    // the task becoming ready to its last chunk finishing, busy adds up
+    // the time of every chunk.
+    double wall;
+    double busy;
+    unsigned long long chunks;
+    unsigned int runs;
+};
+
+/*
+  Tasks and the order they must run in. Built once and run by a TaskPool
+  as many times as needed, every run walks the whole graph.
+ */
+class TaskGraph {
+public:
+    std::vector<Task> tasks;
+
+    // Returns the new task's index
+    int add(const char *name, TaskRun run, TaskCount count, void *data,
+            unsigned int grain);
+    // task may only start once before has finished
+    void depend(int task, int before);
+    void resetStats(void);
+};
+
+// A chunk of one task
+struct TaskJob {
+    int task;
+    unsigned int begin;
+    unsigned int end;
+};
+
+class TaskPool;
+
+struct TaskWorker {
+    TaskPool *pool;
+    int index;
+    pthread_t thread;
+    // Own jobs are taken from the back, thieves take from the front
+    pthread_mutex_t lock;
+    std::deque<TaskJob> jobs;
+    // Chunk time per task during the current run
+    std::vector<double> busy;
+};
+
+/*
+  Persistent worker threads that run a TaskGraph. Each worker keeps a
+  deque of chunks; ready tasks are split into chunks on the deque of the
+  worker that finished their last dependency, and idle workers steal
+  from the others. The thread calling run works as worker 0. Between
+  runs the other workers sleep on a condition variable.
+ */
+class TaskPool {
+public:
+    // threads counts the calling thread
+    TaskPool(int threads);
+    ~TaskPool(void);
+
+    int size(void);
+    // Runs every task of graph and returns once all are done
+    void run(TaskGraph &graph);
+
+    // Chunks taken from another worker's deque during the last run
+    unsigned long long steals;
+
+    // Body of each worker thread
+    static void *workerMain(void *input);
+    // Index of the calling thread in the pool that last ran it, or -1
+    // for a thread no pool has used
+    static int currentWorker(void);
+
+private:
+    std::vector<TaskWorker *> workers;
+    TaskGraph *graph;
+    // Tasks not yet finished in the current run
+    std::atomic<int> tasksLeft;
+    std::atomic<unsigned long long> stealCount;
+    // Per task chunks left and dependencies left, sized to the graph
+    std::atomic<int> *chunksLeft;
+    std::atomic<int> *depsLeft;
+    std::vector<double> readyTime;
+    unsigned int graphSize;
+
+    // Wakes sleeping workers for a new run
+    pthread_mutex_t wakeLock;
+    pthread_cond_t wakeCond;
+    unsigned int generation;
+    bool quit;
+
+    void work(TaskWorker &worker);
+    bool popJob(TaskWorker &worker, TaskJob &job);
+    bool stealJob(TaskWorker &worker, TaskJob &job);
+    void execute(TaskWorker &worker, TaskJob &job);
+    void ready(TaskWorker &worker, int task);
+    void finish(TaskWorker &worker, int task);
+};
+
+#endif
@@ -0,0 +1,45 @@
+#ifndef __TIMER_H
+#define __TIMER_H
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+// Seconds since an arbitrary point, with sub-microsecond resolution.
+// Stand-in for glfwGetTime when there is no window.
+inline double getTime(void) {
+#ifdef _WIN32
+    static LARGE_INTEGER freq;
+    static bool haveFreq = false;
+    if (!haveFreq) {
+        QueryPerformanceFrequency(&freq);
+        haveFreq = true;
+    }
+    LARGE_INTEGER now;
+    QueryPerformanceCounter(&now);
+    return (double)now.QuadPart / (double)freq.QuadPart;
+#else
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec * 1e-9;
+#endif
+}
+
+// Gives up the thread for about seconds, to a millisecond on Windows
+inline void sleepFor(double seconds) {
+    if (seconds <= 0.0) {
+        return;
+    }
+#ifdef _WIN32
+    Sleep((DWORD)(seconds * 1000.0));
+#else
+    timespec wait;
+    wait.tv_sec = (time_t)seconds;
+    wait.tv_nsec = (long)((seconds - wait.tv_sec) * 1e9);
+    nanosleep(&wait, NULL);
+#endif
+}
+
+#endif
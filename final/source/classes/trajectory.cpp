@@ -0,0 +1,370 @@
+#include "trajectory.hpp"
+
+#include <string.h>
+#include <cmath>
+
+// Small changes either side of zero become small unsigned values
+static inline unsigned int zigzag(int v) {
+    return ((unsigned int)v << 1) ^ (unsigned int)(v >> 31);
+}
+
+static inline int unzigzag(unsigned int v) {
+    return (int)(v >> 1) ^ -(int)(v & 1);
+}
+
+static inline void putVarint(std::vector<unsigned char> &out, unsigned int v) {
+    while (v >= 0x80) {
+        out.push_back((unsigned char)(v | 0x80));
+        v >>= 7;
+    }
+    out.push_back((unsigned char)v);
+}
+
+static inline bool getVarint(const unsigned char *&p, const unsigned char *end,
+                             unsigned int &v) {
+    v = 0;
+    for (int shift = 0; shift < 35 && p < end; shift += 7) {
+        unsigned char b = *p++;
+        v |= (unsigned int)(b & 0x7f) << shift;
+        if (!(b & 0x80)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static inline int quantize(float v, float step) {
+    return (int)std::floor(v / step + 0.5f);
+}
+
+TrajectoryWriter::TrajectoryWriter(void) {
+    file = NULL;
+    bytes = 0;
+    quit = false;
+    framesWritten = 0;
+    memset(&header, 0, sizeof(header));
+}
+
+TrajectoryWriter::~TrajectoryWriter(void) {
+    close();
+}
+
+bool TrajectoryWriter::open(const char *name, BodyStore &bodies,
+                            unsigned int encoding, float posStep,
+                            float angleStep, unsigned int keyInterval) {
+    close();
+    file = fopen(name, "wb");
+    if (file == NULL) {
+        return false;
+    }
+    setvbuf(file, NULL, _IOFBF, TRAJ_FILE_BUFFER);
+
+    memcpy(header.magic, TRAJ_MAGIC, 4);
+    header.version = TRAJ_VERSION;
+    header.bodyCount = bodies.size();
+    header.shapeCount = bodies.numShapes();
+    header.encoding = encoding;
+    header.keyInterval = keyInterval > 0 ? keyInterval : 1;
+    header.posStep = posStep;
+    header.angleStep = angleStep;
+    fwrite(&header, sizeof(header), 1, file);
+
+    std::vector<float> verts(header.shapeCount * 6);
+    for (unsigned int s = 0; s < header.shapeCount; s++) {
+        for (int i = 0; i < 3; i++) {
+            verts[s * 6 + i * 2] = bodies.shapes.vertX[i][s];
+            verts[s * 6 + i * 2 + 1] = bodies.shapes.vertY[i][s];
+        }
+    }
+    std::vector<unsigned int> shapeOf(header.bodyCount);
+    for (unsigned int id = 0; id < header.bodyCount; id++) {
+        shapeOf[id] = bodies.shape[bodies.slotOf[id]];
+    }
+    if (!verts.empty()) {
+        fwrite(&verts[0], sizeof(float), verts.size(), file);
+    }
+    if (!shapeOf.empty()) {
+        fwrite(&shapeOf[0], sizeof(unsigned int), shapeOf.size(), file);
+    }
+    bytes = sizeof(header) + verts.size() * sizeof(float) +
+        shapeOf.size() * sizeof(unsigned int);
+
+    framesWritten = 0;
+    offsets.clear();
+    quit = false;
+    pthread_mutex_init(&lock, NULL);
+    pthread_cond_init(&queued, NULL);
+    pthread_cond_init(&drained, NULL);
+    pthread_create(&thread, NULL, writerMain, this);
+    return true;
+}
+
+bool TrajectoryWriter::isOpen(void) const {
+    return file != NULL;
+}
+
+void TrajectoryWriter::write(unsigned int frame, BodyStore &bodies) {
+    if (file == NULL) {
+        return;
+    }
+    unsigned int n = header.bodyCount;
+    pthread_mutex_lock(&lock);
+    // Hold the simulation back rather than queue without bound
+    while (pending.size() >= TRAJ_QUEUE) {
+        pthread_cond_wait(&drained, &lock);
+    }
+    TrajFrame *out;
+    if (!spare.empty()) {
+        out = spare.back();
+        spare.pop_back();
+    } else {
+        out = new TrajFrame();
+    }
+    pthread_mutex_unlock(&lock);
+
+    out->frame = frame;
+    out->midX.resize(n);
+    out->midY.resize(n);
+    out->angle.resize(n);
+    for (unsigned int id = 0; id < n; id++) {
+        unsigned int slot = bodies.slotOf[id];
+        out->midX[id] = bodies.midX[slot];
+        out->midY[id] = bodies.midY[slot];
+        out->angle[id] = bodies.angle[slot];
+    }
+
+    pthread_mutex_lock(&lock);
+    pending.push_back(out);
+    pthread_cond_signal(&queued);
+    pthread_mutex_unlock(&lock);
+}
+
+void TrajectoryWriter::close(void) {
+    if (file == NULL) {
+        return;
+    }
+    pthread_mutex_lock(&lock);
+    quit = true;
+    pthread_cond_signal(&queued);
+    pthread_mutex_unlock(&lock);
+    pthread_join(thread, NULL);
+    writeIndex();
+    pthread_cond_destroy(&drained);
+    pthread_cond_destroy(&queued);
+    pthread_mutex_destroy(&lock);
+    for (unsigned int i = 0; i < spare.size(); i++) {
+        delete spare[i];
+    }
+    spare.clear();
+    fclose(file);
+    file = NULL;
+}
+
+// Encodes and writes queued frames until closed and drained
+void *TrajectoryWriter::writerMain(void *input) {
+    TrajectoryWriter *w = (TrajectoryWriter *)input;
+    while (true) {
+        pthread_mutex_lock(&w->lock);
+        while (w->pending.empty() && !w->quit) {
+            pthread_cond_wait(&w->queued, &w->lock);
+        }
+        if (w->pending.empty()) {
+            pthread_mutex_unlock(&w->lock);
+            break;
+        }
+        TrajFrame *frame = w->pending.front();
+        w->pending.pop_front();
+        pthread_mutex_unlock(&w->lock);
+
+        w->encode(*frame);
+
+        pthread_mutex_lock(&w->lock);
+        w->spare.push_back(frame);
+        pthread_cond_signal(&w->drained);
+        pthread_mutex_unlock(&w->lock);
+    }
+    fflush(w->file);
+    return NULL;
+}
+
+void TrajectoryWriter::encode(TrajFrame &frame) {
+    unsigned int n = header.bodyCount;
+    if (header.encoding != TRAJ_QUANTIZED) {
+        unsigned int size = 3 * n * sizeof(float);
+        payload.resize(size);
+        if (n > 0) {
+            memcpy(&payload[0], &frame.midX[0], n * sizeof(float));
+            memcpy(&payload[n * 4], &frame.midY[0], n * sizeof(float));
+            memcpy(&payload[n * 8], &frame.angle[0], n * sizeof(float));
+        }
+        writeFrame(frame.frame, TRAJ_FRAME_FLOAT);
+        return;
+    }
+
+    const std::vector<float> *blocks[3] = { &frame.midX, &frame.midY,
+                                            &frame.angle };
+    float steps[3] = { header.posStep, header.posStep, header.angleStep };
+    bool key = framesWritten % header.keyInterval == 0;
+    last.resize(3 * n);
+    payload.clear();
+    if (key) {
+        payload.resize(3 * n * sizeof(int));
+    }
+    for (int b = 0; b < 3; b++) {
+        const std::vector<float> &src = *blocks[b];
+        for (unsigned int id = 0; id < n; id++) {
+            int q = quantize(src[id], steps[b]);
+            int &prev = last[b * n + id];
+            if (key) {
+                memcpy(&payload[(b * n + id) * sizeof(int)], &q, sizeof(int));
+            } else {
+                putVarint(payload, zigzag(q - prev));
+            }
+            prev = q;
+        }
+    }
+    writeFrame(frame.frame, key ? TRAJ_FRAME_KEY : TRAJ_FRAME_DELTA);
+}
+
+void TrajectoryWriter::writeFrame(unsigned int frame, unsigned int kind) {
+    TrajFrameHeader head;
+    head.frame = frame;
+    head.kind = kind;
+    head.size = payload.size();
+    offsets.push_back(bytes);
+    fwrite(&head, sizeof(head), 1, file);
+    if (!payload.empty()) {
+        fwrite(&payload[0], 1, payload.size(), file);
+    }
+    bytes += sizeof(head) + payload.size();
+    framesWritten++;
+}
+
+void TrajectoryWriter::writeIndex(void) {
+    TrajFrameHeader head;
+    head.frame = offsets.size();
+    head.kind = TRAJ_FRAME_INDEX;
+    head.size = offsets.size() * sizeof(unsigned long long);
+    TrajTrailer trailer;
+    trailer.indexOffset = bytes;
+    memcpy(trailer.magic, TRAJ_INDEX_MAGIC, 4);
+    trailer.frameCount = offsets.size();
+    fwrite(&head, sizeof(head), 1, file);
+    if (!offsets.empty()) {
+        fwrite(&offsets[0], sizeof(unsigned long long), offsets.size(), file);
+    }
+    fwrite(&trailer, sizeof(trailer), 1, file);
+    bytes += sizeof(head) + head.size + sizeof(trailer);
+}
+
+TrajView TrajFrame::view(void) const {
+    TrajView v;
+    v.frame = frame;
+    v.count = midX.size();
+    v.midX = midX.empty() ? NULL : &midX[0];
+    v.midY = midY.empty() ? NULL : &midY[0];
+    v.angle = angle.empty() ? NULL : &angle[0];
+    return v;
+}
+
+TrajectoryDecoder::TrajectoryDecoder(void) {
+    memset(&header, 0, sizeof(header));
+}
+
+unsigned int TrajectoryDecoder::readHeader(const unsigned char *data,
+                                           unsigned int size) {
+    if (size < sizeof(TrajHeader)) {
+        return 0;
+    }
+    memcpy(&header, data, sizeof(header));
+    if (memcmp(header.magic, TRAJ_MAGIC, 4) != 0 ||
+        header.version != TRAJ_VERSION) {
+        return 0;
+    }
+    unsigned long long need = sizeof(header) +
+        (unsigned long long)header.shapeCount * 6 * sizeof(float) +
+        (unsigned long long)header.bodyCount * sizeof(unsigned int);
+    if (need > size) {
+        return 0;
+    }
+    const unsigned char *p = data + sizeof(header);
+    shapeVerts.resize(header.shapeCount * 6);
+    shapeOf.resize(header.bodyCount);
+    if (!shapeVerts.empty()) {
+        memcpy(&shapeVerts[0], p, shapeVerts.size() * sizeof(float));
+    }
+    p += shapeVerts.size() * sizeof(float);
+    if (!shapeOf.empty()) {
+        memcpy(&shapeOf[0], p, shapeOf.size() * sizeof(unsigned int));
+    }
+    for (unsigned int id = 0; id < header.bodyCount; id++) {
+        if (shapeOf[id] >= header.shapeCount) {
+            return 0;
+        }
+    }
+    last.assign(3 * header.bodyCount, 0);
+    return (unsigned int)need;
+}
+
+bool TrajectoryDecoder::decode(const TrajFrameHeader &head,
+                               const unsigned char *payload, TrajFrame &out) {
+    unsigned int n = header.bodyCount;
+    out.frame = head.frame;
+    out.midX.resize(n);
+    out.midY.resize(n);
+    out.angle.resize(n);
+    std::vector<float> *blocks[3] = { &out.midX, &out.midY, &out.angle };
+
+    if (head.kind == TRAJ_FRAME_FLOAT) {
+        if (head.size != 3 * n * sizeof(float)) {
+            return false;
+        }
+        for (int b = 0; b < 3 && n > 0; b++) {
+            memcpy(&(*blocks[b])[0], payload + b * n * sizeof(float),
+                   n * sizeof(float));
+        }
+        return true;
+    }
+
+    if (head.kind == TRAJ_FRAME_KEY) {
+        if (head.size != 3 * n * sizeof(int)) {
+            return false;
+        }
+        if (n > 0) {
+            memcpy(&last[0], payload, 3 * n * sizeof(int));
+        }
+    } else if (head.kind == TRAJ_FRAME_DELTA) {
+        const unsigned char *p = payload;
+        const unsigned char *end = payload + head.size;
+        for (unsigned int i = 0; i < 3 * n; i++) {
+            unsigned int v;
+            if (!getVarint(p, end, v)) {
+                return false;
+            }
+            last[i] += unzigzag(v);
+        }
+    } else {
+        return false;
+    }
+    float steps[3] = { header.posStep, header.posStep, header.angleStep };
+    for (int b = 0; b < 3; b++) {
+        std::vector<float> &dst = *blocks[b];
+        for (unsigned int id = 0; id < n; id++) {
+            dst[id] = last[b * n + id] * steps[b];
+        }
+    }
+    return true;
+}
+
+void TrajectoryDecoder::vertices(const TrajView &frame, unsigned int id,
+                                 glm::vec2 out[3]) const {
+    const float *local = &shapeVerts[shapeOf[id] * 6];
+    float a = glm::radians(frame.angle[id]);
+    float c = glm::cos(a);
+    float sn = glm::sin(a);
+    float mx = frame.midX[id], my = frame.midY[id];
+    for (int i = 0; i < 3; i++) {
+        float lx = local[i * 2], ly = local[i * 2 + 1];
+        out[i] = glm::vec2(mx + (lx * c - ly * sn), my + (lx * sn + ly * c));
+    }
+}
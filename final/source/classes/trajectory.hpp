@@ -0,0 +1,181 @@
+#ifndef __TRAJECTORY_H
+#define __TRAJECTORY_H
+
+#include <stdio.h>
+#include <vector>
+#include <deque>
+#include <atomic>
+
+#include <glm.hpp>
+
+#include "pthread.h"
+#include "bodyStore.hpp"
+
+/*
+  Binary trajectory files. All values are little endian as written by
+  the machine that recorded them.
+
+    TrajHeader
+    shapeCount * 6 floats   local vertices x0 y0 x1 y1 x2 y2 of each shape
+    bodyCount unsigned ints shape of each body id
+    frames                  TrajFrameHeader then size bytes of payload
+    index                   a TRAJ_FRAME_INDEX frame holding the file
+                            offset of every frame before it
+    TrajTrailer
+
+  Bodies are in id order. A TRAJ_FLOAT frame holds bodyCount floats of
+  centroid x, then of centroid y, then of angle in degrees. Quantized
+  files round each value to a multiple of posStep or angleStep: a key
+  frame holds those multiples as ints in the same three blocks, the
+  frames after it hold the zigzag varint change of each from the frame
+  before. There is a key frame every keyInterval frames.
+
+  The index and trailer are written on close. A file cut short has
+  neither, and readers find its frames by walking the frame headers.
+ */
+
+#define TRAJ_MAGIC "TRJ1"
+#define TRAJ_VERSION 1
+
+// TrajHeader encodings
+#define TRAJ_FLOAT 0
+#define TRAJ_QUANTIZED 1
+
+// TrajFrameHeader kinds
+#define TRAJ_FRAME_FLOAT 0
+#define TRAJ_FRAME_KEY 1
+#define TRAJ_FRAME_DELTA 2
+#define TRAJ_FRAME_INDEX 3
+
+#define TRAJ_INDEX_MAGIC "TIDX"
+
+// Frames from one key frame to the next in quantized files
+#define TRAJ_KEY_INTERVAL 64
+
+// Frames waiting for the writer thread before write blocks
+#define TRAJ_QUEUE 8
+// Bytes buffered by stdio in front of the file
+#define TRAJ_FILE_BUFFER (1 << 20)
+
+struct TrajHeader {
+    char magic[4];
+    unsigned int version;
+    unsigned int bodyCount;
+    unsigned int shapeCount;
+    unsigned int encoding;
+    unsigned int keyInterval;
+    float posStep;
+    float angleStep;
+};
+
+struct TrajFrameHeader {
+    unsigned int frame;
+    unsigned int kind;
+    // Payload bytes after this header
+    unsigned int size;
+};
+
+// Last bytes of a closed file
+struct TrajTrailer {
+    // Offset of the index's TrajFrameHeader
+    unsigned long long indexOffset;
+    char magic[4];
+    unsigned int frameCount;
+};
+
+// Body state of one frame without owning it, each array count long
+struct TrajView {
+    unsigned int frame;
+    unsigned int count;
+    const float *midX;
+    const float *midY;
+    const float *angle;
+};
+
+// Body state of one frame in id order
+struct TrajFrame {
+    unsigned int frame;
+    std::vector<float> midX;
+    std::vector<float> midY;
+    std::vector<float> angle;
+
+    TrajView view(void) const;
+};
+
+/*
+  Records body transforms to a trajectory file. write copies the bodies
+  into a spare frame and queues it; a thread of its own encodes queued
+  frames and writes them out, so the simulation only pays for the copy.
+ */
+class TrajectoryWriter {
+public:
+    TrajectoryWriter(void);
+    ~TrajectoryWriter(void);
+
+    // posStep and angleStep are only used by TRAJ_QUANTIZED. Returns
+    // false if the file could not be created.
+    bool open(const char *file, BodyStore &bodies, unsigned int encoding,
+              float posStep, float angleStep, unsigned int keyInterval);
+    bool isOpen(void) const;
+    void write(unsigned int frame, BodyStore &bodies);
+    // Writes everything queued and closes the file
+    void close(void);
+
+    // Bytes written so far, updated by the writer thread and safe to read
+    // while it runs
+    std::atomic<unsigned long long> bytes;
+
+    static void *writerMain(void *input);
+
+private:
+    FILE *file;
+    TrajHeader header;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t queued;
+    pthread_cond_t drained;
+    std::deque<TrajFrame *> pending;
+    std::vector<TrajFrame *> spare;
+    bool quit;
+
+    // Writer thread state
+    unsigned int framesWritten;
+    std::vector<int> last;
+    std::vector<unsigned char> payload;
+    // Where each frame starts, for the index
+    std::vector<unsigned long long> offsets;
+
+    void encode(TrajFrame &frame);
+    void writeFrame(unsigned int frame, unsigned int kind);
+    void writeIndex(void);
+};
+
+/*
+  Turns a header and frame payloads back into body state. Delta frames
+  build on the previous frame decoded, so frames after a key frame must
+  be decoded in order.
+ */
+class TrajectoryDecoder {
+public:
+    TrajHeader header;
+    // Local vertices of each shape and the shape of each body id
+    std::vector<float> shapeVerts;
+    std::vector<unsigned int> shapeOf;
+
+    TrajectoryDecoder(void);
+
+    // Reads the header and tables from the start of data. Returns the
+    // bytes they took, or 0 if data is not a trajectory.
+    unsigned int readHeader(const unsigned char *data, unsigned int size);
+    // Returns false if the payload is malformed
+    bool decode(const TrajFrameHeader &head, const unsigned char *payload,
+                TrajFrame &out);
+    // World vertices of body id, rebuilt the way BodyStore does
+    void vertices(const TrajView &frame, unsigned int id,
+                  glm::vec2 out[3]) const;
+
+private:
+    std::vector<int> last;
+};
+
+#endif
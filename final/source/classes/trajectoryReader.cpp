@@ -0,0 +1,196 @@
+#include "trajectoryReader.hpp"
+
+#include <string.h>
+
+TrajectoryReader::TrajectoryReader(void) {
+    data = NULL;
+    size = 0;
+    fromTrailer = false;
+    decodedIndex = -1;
+}
+
+TrajectoryReader::~TrajectoryReader(void) {
+    close();
+}
+
+bool TrajectoryReader::open(const char *file) {
+    close();
+    if (!mapped.open(file)) {
+        return false;
+    }
+    data = mapped.data;
+    size = mapped.size;
+    // Tables are far smaller than 4GB, larger sizes only matter to frames
+    unsigned int head = size > 0xffffffffULL ? 0xffffffffU
+        : (unsigned int)size;
+    unsigned int start = decoder.readHeader(data, head);
+    if (start == 0) {
+        close();
+        return false;
+    }
+    if (!readTrailer(start)) {
+        walkFrames(start);
+    }
+    return true;
+}
+
+void TrajectoryReader::close(void) {
+    mapped.close();
+    data = NULL;
+    size = 0;
+    offsets.clear();
+    fromTrailer = false;
+    decodedIndex = -1;
+}
+
+const TrajHeader &TrajectoryReader::header(void) const {
+    return decoder.header;
+}
+
+unsigned int TrajectoryReader::frameCount(void) const {
+    return offsets.size();
+}
+
+unsigned int TrajectoryReader::frameNumber(unsigned int index) const {
+    TrajFrameHeader head;
+    memcpy(&head, data + offsets[index], sizeof(head));
+    return head.frame;
+}
+
+int TrajectoryReader::findFrame(unsigned int number) const {
+    unsigned int lo = 0, hi = offsets.size();
+    while (lo < hi) {
+        unsigned int mid = (lo + hi) / 2;
+        if (frameNumber(mid) < number) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    if (lo < offsets.size() && frameNumber(lo) == number) {
+        return lo;
+    }
+    return -1;
+}
+
+bool TrajectoryReader::indexed(void) const {
+    return fromTrailer;
+}
+
+bool TrajectoryReader::view(unsigned int index, TrajView &out) {
+    if (index >= offsets.size()) {
+        return false;
+    }
+    TrajFrameHeader head;
+    memcpy(&head, data + offsets[index], sizeof(head));
+    const unsigned char *payload = data + offsets[index] + sizeof(head);
+    unsigned int n = decoder.header.bodyCount;
+
+    // Float frames start 4 byte aligned, every size before them is a
+    // multiple of 4
+    if (head.kind == TRAJ_FRAME_FLOAT) {
+        if (head.size != 3 * n * sizeof(float)) {
+            return false;
+        }
+        const float *blocks = (const float *)payload;
+        out.frame = head.frame;
+        out.count = n;
+        out.midX = blocks;
+        out.midY = blocks + n;
+        out.angle = blocks + 2 * n;
+        return true;
+    }
+
+    if ((int)index != decodedIndex) {
+        // Deltas need the frame before, so go back to a key frame unless
+        // the frame before is the one already decoded
+        unsigned int first = index;
+        if (decodedIndex < 0 || (int)index != decodedIndex + 1) {
+            while (first > 0) {
+                TrajFrameHeader prior;
+                memcpy(&prior, data + offsets[first], sizeof(prior));
+                if (prior.kind == TRAJ_FRAME_KEY) {
+                    break;
+                }
+                first--;
+            }
+        }
+        for (unsigned int i = first; i <= index; i++) {
+            TrajFrameHeader step;
+            memcpy(&step, data + offsets[i], sizeof(step));
+            if (!decoder.decode(step, data + offsets[i] + sizeof(step),
+                                decoded)) {
+                decodedIndex = -1;
+                return false;
+            }
+        }
+        decodedIndex = index;
+    }
+    out = decoded.view();
+    return true;
+}
+
+void TrajectoryReader::vertices(const TrajView &frame, unsigned int id,
+                                glm::vec2 out[3]) const {
+    decoder.vertices(frame, id, out);
+}
+
+// Uses the index written on close if it is there and sane
+bool TrajectoryReader::readTrailer(unsigned int start) {
+    TrajTrailer trailer;
+    if (size < start + sizeof(TrajFrameHeader) + sizeof(trailer)) {
+        return false;
+    }
+    memcpy(&trailer, data + size - sizeof(trailer), sizeof(trailer));
+    if (memcmp(trailer.magic, TRAJ_INDEX_MAGIC, 4) != 0 ||
+        trailer.indexOffset < start ||
+        trailer.indexOffset + sizeof(TrajFrameHeader) > size) {
+        return false;
+    }
+    TrajFrameHeader head;
+    memcpy(&head, data + trailer.indexOffset, sizeof(head));
+    unsigned long long bytes =
+        (unsigned long long)trailer.frameCount * sizeof(unsigned long long);
+    if (head.kind != TRAJ_FRAME_INDEX || head.size != bytes ||
+        trailer.indexOffset + sizeof(head) + bytes + sizeof(trailer) != size) {
+        return false;
+    }
+    offsets.resize(trailer.frameCount);
+    if (!offsets.empty()) {
+        memcpy(&offsets[0], data + trailer.indexOffset + sizeof(head), bytes);
+    }
+    // Every frame, payload included, must end before the index, as
+    // walkFrames checks against the end of the file
+    for (unsigned int i = 0; i < offsets.size(); i++) {
+        if (offsets[i] < start ||
+            offsets[i] + sizeof(head) > trailer.indexOffset) {
+            offsets.clear();
+            return false;
+        }
+        TrajFrameHeader frame;
+        memcpy(&frame, data + offsets[i], sizeof(frame));
+        if (offsets[i] + sizeof(frame) + frame.size > trailer.indexOffset) {
+            offsets.clear();
+            return false;
+        }
+    }
+    fromTrailer = true;
+    return true;
+}
+
+// Finds the frames of a file without an index, stopping at the first
+// frame that runs past the end
+void TrajectoryReader::walkFrames(unsigned int start) {
+    unsigned long long pos = start;
+    TrajFrameHeader head;
+    while (pos + sizeof(head) <= size) {
+        memcpy(&head, data + pos, sizeof(head));
+        if (head.kind == TRAJ_FRAME_INDEX ||
+            pos + sizeof(head) + head.size > size) {
+            break;
+        }
+        offsets.push_back(pos);
+        pos += sizeof(head) + head.size;
+    }
+    fromTrailer = false;
+}
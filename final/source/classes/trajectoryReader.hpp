@@ -0,0 +1,60 @@
+#ifndef __TRAJECTORYREADER_H
+#define __TRAJECTORYREADER_H
+
+#include <vector>
+
+#include "trajectory.hpp"
+#include "mappedFile.hpp"
+
+/*
+  Maps a trajectory file into memory and gives random access to its
+  frames. The frame index comes from the file's trailer, or from walking
+  the frame headers if the recording was cut short. Views of TRAJ_FLOAT
+  frames point straight into the mapping; quantized frames are decoded
+  into a buffer of the reader's, starting from the key frame before
+  them unless the previous view was the frame before. A view stays valid
+  until the next call to view or close.
+ */
+class TrajectoryReader {
+public:
+    TrajectoryDecoder decoder;
+
+    TrajectoryReader(void);
+    ~TrajectoryReader(void);
+
+    // Returns false if the file cannot be mapped or is not a trajectory
+    bool open(const char *file);
+    void close(void);
+
+    const TrajHeader &header(void) const;
+    unsigned int frameCount(void) const;
+    // Frame number recorded with the index'th frame
+    unsigned int frameNumber(unsigned int index) const;
+    // Index of the frame recorded as number, or -1. Frame numbers are
+    // increasing, so this is a binary search.
+    int findFrame(unsigned int number) const;
+    // True if the index came from the trailer rather than a walk
+    bool indexed(void) const;
+
+    // Returns false if index is out of range or its frame is damaged
+    bool view(unsigned int index, TrajView &out);
+    // World vertices of body id in a view
+    void vertices(const TrajView &frame, unsigned int id,
+                  glm::vec2 out[3]) const;
+
+private:
+    MappedFile mapped;
+    const unsigned char *data;
+    unsigned long long size;
+    std::vector<unsigned long long> offsets;
+    bool fromTrailer;
+
+    // Last quantized frame decoded
+    TrajFrame decoded;
+    int decodedIndex;
+
+    bool readTrailer(unsigned int start);
+    void walkFrames(unsigned int start);
+};
+
+#endif
@@ -4,9 +4,11 @@
 #include <iostream>
 #include <sstream>
 #include <fstream>
-#include <gtx/rotate_vector.hpp>
 
 /* Triangle definitions. */
+Triangle::Triangle(void) {
+}
+
 Triangle::Triangle(glm::vec2 &v0, glm::vec2 &v1, glm::vec2 &v2) {
     init(v0, v1, v2);
 }
@@ -31,12 +33,6 @@ void Triangle::init(glm::vec2 &v0, glm::vec2 &v1, glm::vec2 &v2) {
 
     velocity = glm::vec2(.0f, .0f);
     rotationalVelocity = .0f;
-	glArraySetup();
-}
-
-//project v2 on v1
-glm::vec2 project(glm::vec2 v1, glm::vec2 v2) {
-    return glm::dot(v2, glm::normalize(v1)) * glm::normalize(v1);
 }
 
 void doIt(glm::vec2* verts, int dim,
@@ -82,195 +78,27 @@ bool Triangle::aabbCollision(Triangle &other) {
  */
 bool Triangle::isCollision(Triangle &other, glm::vec2 &colVec) {
     if (! aabbCollision(other)) { return false; }
-    const glm::vec2 * ptsA = verts;
-    const glm::vec2 * ptsB = other.verts;
-    glm::vec2 midA = midPt();
-    glm::vec2 midB = other.midPt();
-    glm::vec2 norms[6];
-    //All 6 norms of the triangles, first 3 are from outer triangle, last are from inner triangle
-    for (int i = 0; i < 3; i++) {
-        norms[i] = project(ptsB[(i + 1) % 3] - ptsB[i], midB - ptsB[i]);
-        norms[i] = glm::normalize(norms[i] - (midB - ptsB[i]));
-
-        norms[i+3] = project(ptsA[(i + 1) % 3] - ptsA[i], midA - ptsA[i]);
-        norms[i+3] = glm::normalize(norms[i+3] - (midA - ptsA[i]));
-    }
-    float minDepth = FLT_MAX;
-    for (int j = 0; j < 6; j++) {
-        glm::vec2 normal = norms[j];
-        float minA = FLT_MAX;
-        float maxA = -FLT_MAX;
-        float minB = FLT_MAX;
-        float maxB = -FLT_MAX;
-        for (int i = 0; i < 3; i++) {
-            float projDist = glm::dot(ptsA[i], normal);
-            if (projDist < minA) { minA = projDist;}
-            if (projDist > maxA) { maxA = projDist;}
-            projDist = glm::dot(ptsB[i], normal);
-            if (projDist < minB) { minB = projDist;}
-            if (projDist > maxB) { maxB = projDist;}
-        }
-
-        // If we find some gap, return false immeditely
-        if ((minA > maxB) || (maxA < minB)) {
-            return false;
-        } else {
-            //Needs fixing
-            if ((maxA > minB && minB > minA) && (maxA - minB < minDepth)) {
-                colVec = norms[j] * -1.0f * (maxA - minB);
-                minDepth = maxA - minB;
-            } else if ((minA < maxB && minA > minB) && (maxB - minA < minDepth)) {
-                colVec = norms[j] * (maxB - minA);
-                minDepth = maxB - minA;
-            }
-            if (glm::dot(colVec, (midB - midA)) < 0.0f) {
-                colVec *= -1.0f;
-            }
-        }
-    }
-    return true;
-}
-
-
-// Clips v1 and v2 into pts based on whether they are further than cutoff along norm
-// returns the number of points kept stored in pts
-int clip(glm::vec2 v1, glm::vec2 v2, glm::vec2 norm,
-         float cutoff, glm::vec2 *pts) {
-    int kept = 0;
-    float dist1 = glm::dot(norm, v1) - cutoff;
-    float dist2 = glm::dot(norm, v2) - cutoff;
-    if (dist1 > 0.0f) {
-        pts[kept] = v1;
-        kept++;
-    }
-    if (dist2 > 0.0f) {
-        pts[kept] = v2;
-        kept++;
-    }
-    if (dist1 * dist2 < 0.0f) {
-        glm::vec2 dif = v2 - v1;
-        float percLeft = dist1 / (dist1 - dist2);
-        dif *= percLeft;
-        dif += v1;
-        pts[kept] = dif;
-        kept++;
-    }
-    return kept;
+    BodyView a;
+    BodyView b;
+    view(a);
+    other.view(b);
+    return satCollision(a, b, colVec);
 }
 
 // selects an edge from this that is most perpindicular to norm
 // chosenPt is edge furthest along norm
 // Two pts used stored inside edge
 void Triangle::bestEdge(glm::vec2 norm, glm::vec2 &chosenPt, glm::vec2 *edge) {
-    float max = -FLT_MAX;
-    int index = 0;
-    //Make index the pt furthest into other shape
-    for (int i = 0; i < 3; i++) {
-        float proj = glm::dot(norm, verts[i]);
-        if (proj > max) {
-            max = proj;
-            index = i;
-        }
-    }
-    chosenPt = verts[index];
-    glm::vec2 v0 = verts[(index + 2) % 3];
-    glm::vec2 v1 = verts[(index + 1) % 3];
-    glm::vec2 cw = chosenPt - v0;
-    glm::vec2 ccw = chosenPt - v1;
-    // Want the edge most perpendicular
-    if (glm::dot(cw, norm) < glm::dot(ccw, norm)) {
-        edge[0] = v0;
-        edge[1] = chosenPt;
-    } else {
-        edge[0] = chosenPt;
-        edge[1] = v1;
-    }
+    ::bestEdge(verts, norm, chosenPt, edge);
 }
 
-
 // Uses clipping to determine the collision point between triangle A and B
 // given the SAT discovered minimal translation vector colVec
 bool Triangle::findCollisionPt(Triangle &other,
                                glm::vec2 colVec, glm::vec2 &colPt) {
-    const glm::vec2 * ptsA = verts;
-    const glm::vec2 * ptsB = other.verts;
-    glm::vec2 colNorm = glm::normalize(colVec);
-    glm::vec2 edgeA[2];
-    glm::vec2 ptA;
-    glm::vec2 edgeB[2];
-    glm::vec2 ptB;
-    bestEdge(colNorm, ptA, edgeA);
-    other.bestEdge(-1.0f * colNorm, ptB, edgeB);
-
-    glm::vec2 ref[2];
-    glm::vec2 inc[2];
-    glm::vec2 refPt;
-    bool flip = false;
-    float edgeAD =
-        glm::dot(ptA - (ptA == edgeA[0] ? edgeA[1] : edgeA[0]), colNorm);
-    float edgeBD =
-        glm::dot(ptB - (ptB == edgeB[0] ? edgeB[1] : edgeB[0]), colNorm);
-    if (edgeAD < edgeBD) {
-        refPt = ptA;
-        ref[0] = edgeA[0];
-        ref[1] = edgeA[1];
-        inc[0] = edgeB[0];
-        inc[1] = edgeB[1];
-    } else {
-        refPt = ptB;
-        ref[0] = edgeB[0];
-        ref[1] = edgeB[1];
-        inc[0] = edgeA[0];
-        inc[1] = edgeA[1];
-        flip = true;
-    }
-
-    glm::vec2 clipN1 = glm::normalize(ref[1] - ref[0]);
-    glm::vec2 clipped[2];
-    int kept = clip(inc[0], inc[1], clipN1,
-                    glm::dot(ref[0], clipN1), clipped);
-    if (kept < 2) {
-        return false;
-    }
-
-    kept = clip(clipped[0], clipped[1], -1.0f * clipN1,
-                -1.0f * glm::dot(ref[1], clipN1), clipped);
-    if (kept < 2) {
-        return false;
-    }
-
-    glm::vec2 clipN3 = glm::vec2(clipN1[1], clipN1[0] * -1.0f);
-    if (flip) {
-        clipN3 *= -1.0f;
-    }
-    float max = glm::dot(clipN3, refPt);
-
-    float clip0Depth = glm::dot(clipN3, clipped[0]) - max;
-    float clip1Depth = glm::dot(clipN3, clipped[1]) - max;
-    if (clip0Depth < 0.0f) {
-        clipped[0] = clipped[1];
-        kept--;
-    }
-
-    if (clip1Depth < 0.0f) {
-        if (kept == 2) {
-            clipped[0] = clipped[1];
-        }
-        kept--;
-    }
-
-    if (kept == 2) {
-        colPt = (clipped[0] + clipped[1]) / 2.0f;
-        return true;
-    } else if (kept == 1) {
-        colPt = clipped[0];
-        return true;
-    }
-    return false;
+    return clipCollisionPt(verts, other.verts, colVec, colPt);
 }
 
-
-
 /*
   Returns all collisions between this triangle and other. All vectors
   are in form of other - this; i.e. apply force of spring relative to
@@ -293,52 +121,18 @@ bool Triangle::collide(Triangle &other) {
     return true;
 }
 
-void capFloat(float& input, float max) {
-    if (input > max) {
-        input = max;
-    } else if (input < -max) {
-        input = -max;
-    }
-}
-
 /*
   Fixes the collision specified by col by applying force to both the triangles
   t1 and t2 according to hookes law.
   t1 is this, t2 is other.
  */
- void Triangle::handleCollisions(Triangle &other, glm::vec2 colPt,
-                                 glm::vec2 sprVec) {
-    //force is sum total of forces of each spring in cols
-    // This is only doing linear force
-    glm::vec2 linForce(0.0f, 0.0f);
-    float t1RotForce = 0.0f;
-    float t2RotForce = 0.0f;
-
-    glm::vec2 force = sprVec * HOOKE_CONSTANT;
-    linForce += force;
-    //project Force onto radius line
-    //subtract of this to get perpindicular force
-    glm::vec2 t1Radius = colPt - midPt();
-    glm::vec2 t2Radius = colPt - other.midPt();
-    glm::vec2 t1PerpForce = force - glm::dot(force, glm::normalize(t1Radius));
-    glm::vec2 t2PerpForce = force - glm::dot(force, glm::normalize(t2Radius));
-
-    // CCW checks to see what direction the rotation is in
-    // It would be great to replace with something cheaper
-    bool ccw = glm::cross(glm::vec3(t1PerpForce, 0.0f),
-                          glm::vec3(t1Radius, 0.0f)).z > 0.0f;
-    bool ccw2 = glm::cross(glm::vec3(t2PerpForce, 0.0f),
-                           glm::vec3(t2Radius, 0.0f)).z > 0.0f;
-
-    t1RotForce +=  (-1.0f + ccw * 2.0f) * glm::length(t1PerpForce)
-        / glm::length(t1Radius);
-    t2RotForce +=  (-1.0f + ccw2 * 2.0f) * glm::length(t2PerpForce)
-        / glm::length(t2Radius);
-
-    capFloat(linForce[0], 1.0f);
-    capFloat(linForce[1], 1.0f);
-    capFloat(t1RotForce, 0.4f);
-    capFloat(t2RotForce, 0.4f);
+void Triangle::handleCollisions(Triangle &other, glm::vec2 colPt,
+                                glm::vec2 sprVec) {
+    glm::vec2 linForce;
+    float t1RotForce;
+    float t2RotForce;
+    springForces(midPt(), other.midPt(), colPt, sprVec,
+                 linForce, t1RotForce, t2RotForce);
     //Apply force to both triangles in opposite directions
     // dv = F * 1/m
     velocity += linForce * invMass;
@@ -348,23 +142,13 @@ void capFloat(float& input, float max) {
     other.rotationalVelocity -= t2RotForce * other.invMass;
 }
 
-// Moves the triangle forward in time by delta applying gravity
-void Triangle::timeStep(float delta) {
-    if (invMass == 0.0f) {
-        return;
-    }
-    glm::vec2 mid = midPt();
-    float rotation = rotationalVelocity * delta;
-    for (int i = 0 ; i < 3; i++) {
-        glm::vec2 rad = verts[i] - mid;
-        glm::vec2 rotDelta = glm::rotate(rad, rotation);
-        verts[i] = mid + rotDelta;
-        verts[i] += velocity * delta;
+// Fill v with everything the narrowphase kernels need, computed fresh
+void Triangle::view(BodyView &v) {
+    for (int i = 0; i < 3; i++) {
+        v.pts[i] = verts[i];
     }
-    velocity += glm::vec2(.0f, -10.0f) * delta;
-    //Simulate air drag
-    rotationalVelocity *= 0.9995f;
-    velocity *= 0.9995f;
+    v.mid = midPt();
+    edgeNormals(v.pts, v.mid, v.norms);
 }
 
 // Determine midpoint of triangle, assumes constant density so simply average
@@ -375,32 +159,6 @@ glm::vec2 Triangle::midPt(void) {
 }
 
 
-// Setup the VBO for this triangle
-void Triangle::glArraySetup(void) {
-	//Setup vertex buffer
-	glGenBuffers(1, &vertexBuf);
-	glBindBuffer(GL_ARRAY_BUFFER, vertexBuf);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(verts), verts, GL_DYNAMIC_DRAW);
-}
-
-// Update the VBO with the current position of verts
-void Triangle::glRedoVBO(void) {
-	glBindBuffer(GL_ARRAY_BUFFER, vertexBuf);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(verts), verts, GL_DYNAMIC_DRAW);
-}
-
-void Triangle::drawSelf(void) {
-	// set up vertices
-    glRedoVBO();
-	glEnableVertexAttribArray(0);
-	glBindBuffer(GL_ARRAY_BUFFER, vertexBuf);
-	glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 0,(void*)0);
-
-    glDrawArrays(GL_TRIANGLES, 0, 3);
-
-	glDisableVertexAttribArray(0);
-}
-
 void Triangle::print(void) {
 	std::cout << "Triangle:\n";
 	std::cout << verts[0][0] << " " << verts[0][1] << "\n";
@@ -413,7 +171,3 @@ std::string Triangle::coords(void) {
 	ss << verts[0][0] << "," << verts[0][1] << " " << verts[1][0] << "," << verts[1][1] << " " << verts[2][0] << "," << verts[2][1];
 	return ss.str();
 }
-
-Triangle::~Triangle(void) {
-	glDeleteBuffers(1, &vertexBuf);
-}
@@ -1,14 +1,13 @@
 #ifndef __TRIANGLE_H
 #define __TRIANGLE_H
 
-//OpenGL headers
-#include <GL/glew.h>
-#include <GL/glfw.h>
 #include <glm.hpp>
 #include <algorithm>
+#include <cfloat>
+#include <string>
 #include <vector>
 
-#define HOOKE_CONSTANT 10.0f
+#include "narrowphase.hpp"
 
 class Collision;
 
@@ -20,9 +19,9 @@ public:
     glm::vec2 velocity;
     float rotationalVelocity;
     float invMass;
-	//OpenGl info
-	GLuint vertexBuf;
 
+    //Uninitialized triangle, filled in by BodyStore::load
+    Triangle(void);
     //Create triangle with these 3 points
     Triangle(glm::vec2 &v0, glm::vec2 &v1, glm::vec2 &v2);
     //Equilateral triangle construct
@@ -46,18 +45,12 @@ public:
     ///
     ///
 
-	void timeStep(float delta);
     glm::vec2 midPt(void);
-    // OpenGL functions
-	void glArraySetup(void);
-	void glRedoVBO(void);
-	void drawSelf();
+    void view(BodyView &v);
     // Debug print
 	void print(void);
 	// Return a string of the oordinates
 	std::string coords(void);
-    //Cleans up opengl buffer
-	~Triangle(void);
 };
 
 #endif
@@ -0,0 +1,431 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <string>
+#include <vector>
+#include <iostream>
+#include <fstream>
+#include <algorithm>
+
+using namespace std;
+
+#include "triangle.hpp"
+#include "grid.hpp"
+#include "stepController.hpp"
+#include "scene.hpp"
+#include "timer.hpp"
+#include "trajectory.hpp"
+
+void usage(void) {
+    fprintf(stderr, "Usage: headless [-frames N] [-scene file] [-out file]\n"
+            "                [-record file] [-quantize step]"
+            " [-save-scene file]\n"
+            "                [-broadphase strip|cell|tree|sweep]"
+            " [-cache] [-reuse distance]\n"
+            "                [-threads N] [-pool N]"
+            " [-profile prefix] [-trace file]\n"
+            "                [-deterministic] [-check-determinism N]"
+            " [-sleep] [-adaptive]\n");
+}
+
+// Settings runHashes copies to each Grid it builds
+struct RunSettings {
+    BroadphaseType broadphase;
+    bool useCache;
+    float reuseDistance;
+    bool deterministic;
+    bool allowSleep;
+    bool adaptive;
+    int frames;
+    int substeps;
+    float stepTime;
+};
+
+// Runs the scene from the start with threads OpenMP threads, or on a
+// pool of that many workers, and keeps the state hash of every frame
+void runHashes(const std::vector<Triangle> &tris,
+               const std::vector<Triangle> &statics, float width,
+               const RunSettings &run, int threads, bool usePool,
+               std::vector<unsigned int> &hashes) {
+    std::vector<Triangle> bodies = tris;
+    std::vector<Triangle> fixed = statics;
+    Grid gr(bodies, fixed, width * 2.0f, run.broadphase);
+    gr.useCache = run.useCache;
+    gr.cache.reuseDistance = run.reuseDistance;
+    gr.deterministic = run.deterministic;
+    gr.allowSleep = run.allowSleep;
+    gr.numThreads = threads;
+    TaskPool *pool = NULL;
+    if (usePool) {
+        pool = new TaskPool(threads);
+        gr.pool = pool;
+    }
+    StepController steps(run.substeps * run.stepTime);
+    hashes.clear();
+    for (int frame = 1; frame <= run.frames; frame++) {
+        if (run.adaptive) {
+            steps.frame(gr);
+        } else {
+            for (int i = 0; i < run.substeps; i++) {
+                gr.substep(run.stepTime);
+            }
+        }
+        hashes.push_back(gr.bodies.stateHash());
+    }
+    gr.pool = NULL;
+    delete pool;
+}
+
+// Index of the first frame where two runs differ, or -1
+int firstDifference(const std::vector<unsigned int> &a,
+                    const std::vector<unsigned int> &b) {
+    for (unsigned int f = 0; f < a.size() && f < b.size(); f++) {
+        if (a[f] != b[f]) {
+            return f;
+        }
+    }
+    return a.size() == b.size() ? -1 : std::min(a.size(), b.size());
+}
+
+/*
+  Runs the scene on one thread, then on threads OpenMP threads and on a
+  pool of threads workers, and checks every frame of the later runs has
+  the same state, bit for bit, as the first. Returns the exit code.
+ */
+int checkDeterminism(const std::vector<Triangle> &tris,
+                     const std::vector<Triangle> &statics, float width,
+                     const RunSettings &run, int threads) {
+    std::vector<unsigned int> reference, other;
+    runHashes(tris, statics, width, run, 1, false, reference);
+    printf("%2d %-8s %08x after %d frames\n", 1, "thread:", reference.back(),
+           run.frames);
+    bool same = true;
+    for (int usePool = 0; usePool < 2; usePool++) {
+        runHashes(tris, statics, width, run, threads, usePool != 0, other);
+        int diff = firstDifference(reference, other);
+        printf("%2d %-8s %08x", threads, usePool ? "workers:" : "threads:",
+               other.back());
+        if (diff < 0) {
+            printf(" identical\n");
+        } else {
+            printf(" differs from frame %d\n", diff + 1);
+            same = false;
+        }
+    }
+    return same ? 0 : 1;
+}
+
+// Average time per run of each task since the last report
+void printTasks(TaskGraph &graph, unsigned long long steals) {
+    for (unsigned int t = 0; t < graph.tasks.size(); t++) {
+        Task &task = graph.tasks[t];
+        if (task.runs == 0) {
+            continue;
+        }
+        printf("  %-10s wall %8.3fms busy %8.3fms %6.1f chunks\n", task.name,
+               task.wall / task.runs * 1000, task.busy / task.runs * 1000,
+               (double)task.chunks / task.runs);
+    }
+    printf("  Steals in last substep: %llu\n", steals);
+}
+
+//****************************************************
+// Runs the same scene as main.cpp without a window.
+//****************************************************
+int main(int argc, char *argv[]) {
+    int maxFrames = 1000;
+    const char *sceneFile = NULL;
+    const char *outFile = NULL;
+    const char *recordFile = NULL;
+    const char *saveScene = NULL;
+    float quantStep = 0.0f;
+    BroadphaseType broadphase = STRIP_BROADPHASE;
+    bool useCache = false;
+    float reuseDistance = 0.0f;
+    int threads = 0;
+    int poolThreads = 0;
+    const char *profileFile = NULL;
+    const char *traceFile = NULL;
+    bool deterministic = false;
+    bool allowSleep = false;
+    bool adaptive = false;
+    int checkThreads = 0;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "-cache") {
+            useCache = true;
+            continue;
+        }
+        if (arg == "-deterministic") {
+            deterministic = true;
+            continue;
+        }
+        if (arg == "-sleep") {
+            allowSleep = true;
+            continue;
+        }
+        if (arg == "-adaptive") {
+            adaptive = true;
+            continue;
+        }
+        if (i + 1 >= argc) {
+            usage();
+            return 1;
+        }
+        if (arg == "-frames") {
+            maxFrames = atoi(argv[++i]);
+        } else if (arg == "-scene") {
+            sceneFile = argv[++i];
+        } else if (arg == "-out") {
+            outFile = argv[++i];
+        } else if (arg == "-save-scene") {
+            saveScene = argv[++i];
+        } else if (arg == "-record") {
+            recordFile = argv[++i];
+        } else if (arg == "-quantize") {
+            quantStep = (float)atof(argv[++i]);
+        } else if (arg == "-broadphase") {
+            std::string type = argv[++i];
+            if (type == "strip") {
+                broadphase = STRIP_BROADPHASE;
+            } else if (type == "cell") {
+                broadphase = CELL_BROADPHASE;
+            } else if (type == "tree") {
+                broadphase = TREE_BROADPHASE;
+            } else if (type == "sweep") {
+                broadphase = SWEEP_BROADPHASE;
+            } else {
+                usage();
+                return 1;
+            }
+        } else if (arg == "-profile") {
+            profileFile = argv[++i];
+        } else if (arg == "-trace") {
+            traceFile = argv[++i];
+        } else if (arg == "-check-determinism") {
+            checkThreads = atoi(argv[++i]);
+        } else if (arg == "-pool") {
+            poolThreads = atoi(argv[++i]);
+        } else if (arg == "-threads") {
+            threads = atoi(argv[++i]);
+        } else if (arg == "-reuse") {
+            reuseDistance = (float)atof(argv[++i]);
+            useCache = true;
+        } else {
+            usage();
+            return 1;
+        }
+    }
+
+    ofstream outStream;
+    // if debugging output file is present
+    if (outFile != NULL) {
+        outStream.open(outFile);
+    }
+
+    //collection of triangles in scene
+    std::vector<Triangle> tris = std::vector<Triangle>();
+    if (sceneFile != NULL) {
+        if (!loadSceneFile(sceneFile, tris)) {
+            fprintf(stderr, "Failed to open scene %s\n", sceneFile);
+            return 1;
+        }
+    }
+    // Binary copy of the loaded scene, which loads without parsing
+    if (saveScene != NULL && !saveSceneBinary(saveScene, tris)) {
+        fprintf(stderr, "Failed to write scene %s\n", saveScene);
+        return 1;
+    }
+
+    std::vector<Triangle> statics = std::vector<Triangle>();
+    float width = buildDefaultScene(tris, statics, 80);
+    int substeps = 10;
+    // same step as the windowed build
+    float stepTime = 0.0005f;
+
+    if (checkThreads > 0) {
+        RunSettings run;
+        run.broadphase = broadphase;
+        run.useCache = useCache;
+        run.reuseDistance = reuseDistance;
+        run.deterministic = deterministic;
+        run.allowSleep = allowSleep;
+        run.adaptive = adaptive;
+        run.frames = maxFrames;
+        run.substeps = substeps;
+        run.stepTime = stepTime;
+        return checkDeterminism(tris, statics, width, run, checkThreads);
+    }
+
+    Grid gr(tris, statics, width * 2.0f, broadphase);
+    gr.useCache = useCache;
+    gr.deterministic = deterministic;
+    gr.allowSleep = allowSleep;
+    if (threads > 0) {
+        gr.numThreads = threads;
+    }
+    // Run substeps as a task graph on a persistent pool
+    TaskPool *pool = NULL;
+    if (poolThreads > 0) {
+        pool = new TaskPool(poolThreads);
+        gr.pool = pool;
+    }
+    gr.cache.reuseDistance = reuseDistance;
+    // Substeps per frame picked from the state, filling the same frame
+    StepController steps(substeps * stepTime);
+    // Phase timings and counters of every substep
+    Profiler profiler;
+    profiler.tracing = traceFile != NULL;
+    if (profileFile != NULL || traceFile != NULL) {
+        gr.profiler = &profiler;
+    }
+
+    // Binary recording, positions and angles share the quantize step
+    TrajectoryWriter recorder;
+    if (recordFile != NULL &&
+        !recorder.open(recordFile, gr.bodies,
+                       quantStep > 0.0f ? TRAJ_QUANTIZED : TRAJ_FLOAT,
+                       quantStep, quantStep, TRAJ_KEY_INTERVAL)) {
+        fprintf(stderr, "Failed to create %s\n", recordFile);
+        return 1;
+    }
+
+    //time keeping
+    double engineTime = 0.0;
+    double totalTime = 0.0;
+    double outputTime = 0.0;
+    //sort counters since the last report
+    unsigned long long sortMoves = 0;
+    unsigned long long maxSortMoves = 0;
+    int radixSorts = 0;
+    //pair cache counters since the last report
+    unsigned long long lookups = 0;
+    unsigned long long hits = 0;
+    unsigned long long earlyExits = 0;
+    unsigned long long reused = 0;
+    //substeps since the last report and in total
+    int numSubsteps = 0;
+    double totalSubsteps = 0.0;
+    int numFrames = 0;
+
+    for (int frame = 1; frame <= maxFrames; frame++) {
+        double begEngine = getTime();
+        if (adaptive) {
+            steps.plan(gr);
+            substeps = steps.substeps;
+            stepTime = steps.stepTime;
+        }
+        for (int i = 0; i < substeps; i++) {
+            gr.substep(stepTime);
+            if (adaptive) {
+                steps.observe(gr);
+            }
+            sortMoves += gr.sortMoves;
+            maxSortMoves = std::max(maxSortMoves, gr.sortMoves);
+            radixSorts += gr.sortUsedRadix;
+            lookups += gr.cache.lookups;
+            hits += gr.cache.hits;
+            earlyExits += gr.cache.earlyExits;
+            reused += gr.cache.reused;
+        }
+        double endEngine = getTime();
+        engineTime += endEngine - begEngine;
+        totalTime += endEngine - begEngine;
+        numSubsteps += substeps;
+        totalSubsteps += substeps;
+
+        numFrames++;
+        if (numFrames > 9) {
+            std::cout << "Frame " << frame << " Engine: "
+                      << engineTime / numFrames * 1000 << "ms per frame\n";
+            std::cout << "  Sort: " << sortMoves / numSubsteps
+                      << " swaps per substep, max " << maxSortMoves
+                      << ", " << radixSorts << " radix sorts\n";
+            if (lookups > 0) {
+                std::cout << "  Pair cache: " << lookups / numSubsteps
+                          << " pairs per substep, "
+                          << 100.0 * hits / lookups << "% hits, "
+                          << 100.0 * earlyExits / lookups << "% early exits, "
+                          << 100.0 * reused / lookups << "% reused\n";
+            }
+            if (adaptive) {
+                std::cout << "  Steps: " << (double)numSubsteps / numFrames
+                          << " substeps per frame, last "
+                          << stepTime * 1000 << "ms (speed "
+                          << steps.speedStep * 1000 << "ms, springs "
+                          << steps.springStep * 1000 << "ms, depth "
+                          << steps.depthStep * 1000 << "ms)\n";
+                std::cout << "  Max speed " << steps.maxSpeed
+                          << ", deepest contact " << steps.maxDepth << "\n";
+            }
+            if (allowSleep) {
+                std::cout << "  Sleeping: " << gr.islands.sleepingCount
+                          << " bodies, " << gr.islands.islandCount
+                          << " awake islands\n";
+            }
+            if (pool != NULL) {
+                printTasks(gr.stepGraph, pool->steals);
+                gr.stepGraph.resetStats();
+            }
+            sortMoves = 0;
+            maxSortMoves = 0;
+            radixSorts = 0;
+            lookups = 0;
+            hits = 0;
+            earlyExits = 0;
+            reused = 0;
+            engineTime = 0.0;
+            numSubsteps = 0;
+            numFrames = 0;
+        }
+
+        double begOutput = getTime();
+        if (outStream.is_open()) {
+            gr.bodies.writeTriangles(tris);
+            printTimestep(frame, &outStream, tris);
+        }
+        recorder.write(frame, gr.bodies);
+        outputTime += getTime() - begOutput;
+    }
+
+    double begOutput = getTime();
+    if (outStream.is_open()) {
+        outStream.close();
+    }
+    bool recorded = recorder.isOpen();
+    recorder.close();
+    outputTime += getTime() - begOutput;
+
+    delete pool;
+
+    double bodySteps = (double)tris.size() * totalSubsteps;
+    std::cout << "Bodies: " << tris.size() << " Frames: " << maxFrames
+              << " Total: " << totalTime << "s\n";
+    if (outFile != NULL || recorded) {
+        std::cout << "Output: " << outputTime << "s";
+        if (recorded) {
+            std::cout << ", recorded " << recorder.bytes.load() << " bytes";
+        }
+        std::cout << "\n";
+    }
+    std::cout << "Throughput: " << bodySteps / totalTime
+              << " body-substeps per second\n";
+
+    if (gr.profiler != NULL) {
+        profiler.report();
+    }
+    if (profileFile != NULL) {
+        std::string prefix = profileFile;
+        if (!profiler.writeCsv((prefix + ".csv").c_str()) ||
+            !profiler.writeJson((prefix + ".json").c_str())) {
+            fprintf(stderr, "Failed to write profile %s\n", profileFile);
+            return 1;
+        }
+    }
+    if (traceFile != NULL && !profiler.writeTrace(traceFile)) {
+        fprintf(stderr, "Failed to write trace %s\n", traceFile);
+        return 1;
+    }
+    return 0;
+}
@@ -33,17 +33,30 @@ using namespace std;
 
 #include "triangle.hpp"
 #include "grid.hpp"
-
-// Funtion that prints to stdout or a file the state at each timestep
-int printTimestep(int framenum, ofstream * myfile, std::vector<Triangle> tris) {
-	std::stringstream ss (std::stringstream::in | std::stringstream::out);
-	ss << framenum;
-	for (int i = 0; i < tris.size(); i++) {
-        ss << "\t" << tris[i].coords();
-    }
-	ss << "\n";
-	*myfile << ss.str();
-	return 0;
+#include "scene.hpp"
+#include "renderer.hpp"
+#include "simThread.hpp"
+#include "timer.hpp"
+#include "trajectory.hpp"
+
+// Simulated frames per second of wall time, each frame is 0.005s of
+// simulated time
+#define SIM_FRAME_RATE 60.0
+// Frames written to the debug output file before quitting
+#define MAX_DEBUG_FRAMES 1000
+// Substeps the -profile summary covers, about a minute at 10 a frame
+#define PROFILE_SUBSTEPS 36000
+
+// Runs on the simulation thread after every frame. Frames are recorded
+// in binary, trajconv turns them into the old text output.
+bool writeDebugFrame(Grid &gr, unsigned int frame, void *data) {
+	TrajectoryWriter *recorder = (TrajectoryWriter *)data;
+	recorder->write(frame, gr.bodies);
+	if (frame == MAX_DEBUG_FRAMES) {
+		recorder->close();
+		return false;
+	}
+	return true;
 }
 
 //****************************************************
@@ -51,10 +64,15 @@ int printTimestep(int framenum, ofstream * myfile, std::vector<Triangle> tris) {
 //****************************************************
 int main(int argc, char *argv[]) {
 
-	ofstream outStream;
-	// if debugging output file is present
-	if (argc > 1) {
-		outStream.open(argv[2]);
+	// main [-profile] [scene file] [debug output file]
+	bool profiling = false;
+	std::vector<char *> files;
+	for (int i = 1; i < argc; i++) {
+		if (std::string(argv[i]) == "-profile") {
+			profiling = true;
+		} else {
+			files.push_back(argv[i]);
+		}
 	}
 
 	//collection of triangles in scene
@@ -114,117 +132,89 @@ int main(int argc, char *argv[]) {
 	//****************************************************
 	// Read in the input file and create orresponding triangles
 	//****************************************************
-    if (argc > 1) {
-        ifstream fin;
-        fin.open(argv[1]);
-        if (!fin.good())
+    if (files.size() > 0) {
+        if (!loadSceneFile(files[0], tris))
             return 1;
-
-        while (!fin.eof())
-            {
-                char buf[512];
-                fin.getline(buf, 512);
-                float x = ::atof(strtok(buf, " "));
-                float y = ::atof(strtok(0, " "));
-                glm::vec2 center = glm::vec2(x, y);
-                float width = ::atof(strtok(0, " "));
-                Triangle t = Triangle(center, width);
-                t.invMass = 1.0f;
-                tris.push_back(t);
-            }
     }
 
 	//****************************************************
 	// Load in objects to world
 	//****************************************************
 
-    srand(6);
-    glm::vec2 upLeft(-500.0f, 500.0f);
-    glm::vec2 downRight(500.0f, -500.0f);
-    int divs = 80;
-    float width = (downRight[0] - upLeft[0]) / divs / 3.0f;
-    for (int i = 0; i < divs; i++) {
-        float port = (downRight[0] - upLeft[0]) / divs;
-        for (int j = 0; j < divs; j++) {
-            float centerX = upLeft[0] + port * i + (float)rand() / RAND_MAX;
-            float centerY = downRight[1] + port * j + (float)rand() / RAND_MAX;
-            glm::vec2 center(centerX, centerY);
-            Triangle t = Triangle(center, width);
-            t.invMass = 1.0f;
-            tris.push_back(t);
-        }
-    }
-
-    //Base triangle
-    Triangle base = Triangle(glm::vec2(-600.0f, -530.0f), glm::vec2(0.0f, -1200.0f), glm::vec2(600.0f, -530.0f));
-    // Inverse mass of 0 means infinite mass a.k.a. static object
-    base.invMass = 0.0f;
 	std::vector<Triangle> statics = std::vector<Triangle>();
-    statics.push_back(base);
+    float width = buildDefaultScene(tris, statics, 80);
 
     Grid gr(tris, statics, width * 2.0f);
+    // Let the pile on the base fall asleep once it settles
+    gr.allowSleep = true;
 
 	//****************************************************
 	// Setup uniforms
 	//****************************************************
 	GLuint mvpId = glGetUniformLocation(programID, "mvpMat");
+	Renderer renderer;
+	// Upload statics before the simulation thread takes over the grid
+	renderer.setStatics(gr.statics);
 
-	//time keeping
-	double engineTime = 0.0;
-	double midEngineTime = 0.0;
-	int numFrames = 0;
-	int totalFrames = 0;
+	//****************************************************
+	// Physics engine, on its own thread
+	//****************************************************
+	// messy/bad at 0.001f with 900
+	// ok at 0.0005f; up to 900
+	// A frame is 10 steps of this length. The controller splits it into
+	// fewer, longer steps while the scene is calm.
+	float stepTime = 0.0005f;
+	StepController steps(10 * stepTime);
+	// if debugging output file is present
+	TrajectoryWriter recorder;
+	if (files.size() > 1 &&
+		!recorder.open(files[1], gr.bodies, TRAJ_FLOAT, 0.0f, 0.0f,
+					   TRAJ_KEY_INTERVAL)) {
+		fprintf(stderr, "Failed to create %s\n", files[1]);
+	}
+	// Phase timings of the last substeps, summed up on exit. Only with
+	// -profile, as timing every span costs a few percent.
+	Profiler profiler;
+	profiler.maxSamples = PROFILE_SUBSTEPS;
+	if (profiling) {
+		gr.profiler = &profiler;
+	}
+	SimThread sim(gr, stepTime, 10, SIM_FRAME_RATE);
+	sim.controller = &steps;
+	if (recorder.isOpen()) {
+		sim.hook = writeDebugFrame;
+		sim.hookData = &recorder;
+	}
+	sim.start();
 
-	int MAX_DEBUG_FRAMES = 1000;
+	//time keeping
+	unsigned int statFrame = 0;
+	double statEngine = 0.0;
 
 	do{
         //****************************************************
         // FPS / time calculations
         //****************************************************
-        numFrames++;
-		totalFrames++;
-        if ( numFrames > 9 ){
-            double perEngineTime = engineTime / 10 * 1000;
-            double midEng = midEngineTime / engineTime * 100;
+        sim.snapshots.acquire();
+        const BodySnapshot &prev = sim.snapshots.previous();
+        const BodySnapshot &cur = sim.snapshots.current();
+        if (cur.frame >= statFrame + 10) {
+            unsigned int frames = cur.frame - statFrame;
+            double perEngineTime =
+                (cur.totalEngineTime - statEngine) / frames * 1000;
+            double midEng = cur.lastSubstepTime * 1000;
             std::cout << " Engine: " << perEngineTime << "ms per frame\n";
-            std::cout << " Collis: " << midEng << "% per frame\n\n";
-            engineTime = 0.0;
-            midEngineTime = 0.0;
-            numFrames = 0;
-        }
-        //****************************************************
-        // Physics engine
-        //****************************************************
-        double begEngine = glfwGetTime();
-        double midEngine;
-
-        //Simulation/collision
-        // messy/bad at 0.001f with 900
-        // ok at 0.0005f; up to 900
-        float stepTime = 0.0005f;
-        for (int i = 0; i < 10; i++) {
-            gr.stepAll(stepTime);
-            gr.initialSort();
-            midEngine = glfwGetTime(); //timestamp again to see collisions
-            gr.rebalance();
+            std::cout << " Last substep: " << midEng << "ms, "
+                      << cur.substeps << " substeps of "
+                      << cur.stepTime * 1000 << "ms\n\n";
+            statFrame = cur.frame;
+            statEngine = cur.totalEngineTime;
         }
 
         // Change fov, allowing user to move
         // Use - or 0 keys
         glm::mat4 proj = projection();
 
-        double endEngine = glfwGetTime();
-        engineTime += endEngine - begEngine;
-        midEngineTime += endEngine - midEngine;
-
-		if (argc > 1) {
-			printTimestep(totalFrames, &outStream, tris);
-			if (totalFrames == MAX_DEBUG_FRAMES) {
-				outStream.close();
-				return 0;
-			}
-		}
-
         //****************************************************
         // OpenGL rendering
         //****************************************************
@@ -237,24 +227,31 @@ int main(int argc, char *argv[]) {
         glm::mat4 mvp = proj * view;
         glUniformMatrix4fv(mvpId, 1, GL_FALSE, &mvp[0][0]);
 
-        //Go over each Triangle and have them draw themselves
-        for (unsigned int i = 0; i < tris.size(); i++) {
-            tris[i].drawSelf();
-        }
-
-        for (unsigned int i = 0; i < statics.size(); i++) {
-            statics[i].drawSelf();
+        // Draw one frame behind the simulation, sliding from the previous
+        // snapshot to the current one over a frame's time
+        float alpha = 1.0f;
+        if (prev.frame > 0 && cur.wallTime > prev.wallTime) {
+            alpha = (float)((getTime() - cur.wallTime) /
+                            (cur.wallTime - prev.wallTime));
+            alpha = std::min(std::max(alpha, 0.0f), 1.0f);
         }
+        renderer.draw(prev, cur, alpha, gr.bodies.shapes);
+        renderer.drawStatic();
 
         // Swap buffers
         glfwSwapBuffers();
 
 	} // Check if the ESC key was pressed or the window was closed
 	while( glfwGetKey(GLFW_KEY_ESC) != GLFW_PRESS &&
-		   glfwGetWindowParam(GLFW_OPENED));
+		   glfwGetWindowParam(GLFW_OPENED) && sim.running());
 
-	glfwTerminate(); // Close OpenGL window and terminate GLFW
+	sim.stop();
+	recorder.close();
+	profiler.report();
+	// GL objects go while the context is still there
+	renderer.release();
 	glDeleteVertexArrays(1, &VertexArrayID); // Cleanup VBO
+	glfwTerminate(); // Close OpenGL window and terminate GLFW
 
 	return 0;
 }
@@ -0,0 +1,76 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <string>
+#include <vector>
+#include <iostream>
+#include <fstream>
+
+using namespace std;
+
+#include "triangle.hpp"
+#include "scene.hpp"
+#include "trajectoryReader.hpp"
+
+void usage(void) {
+    fprintf(stderr, "Usage: trajconv in.traj out.txt [first last]\n"
+            "Writes a recorded trajectory, or frames first to last of it,"
+            " in the text\nformat of printTimestep.\n");
+}
+
+int main(int argc, char *argv[]) {
+    if (argc != 3 && argc != 5) {
+        usage();
+        return 1;
+    }
+    TrajectoryReader reader;
+    if (!reader.open(argv[1])) {
+        fprintf(stderr, "%s is not a trajectory\n", argv[1]);
+        return 1;
+    }
+    unsigned int count = reader.frameCount();
+    if (count == 0) {
+        fprintf(stderr, "%s has no frames\n", argv[1]);
+        return 1;
+    }
+    unsigned int first = 0;
+    unsigned int last = count - 1;
+    if (argc == 5) {
+        int a = reader.findFrame(atoi(argv[3]));
+        int b = reader.findFrame(atoi(argv[4]));
+        if (a < 0 || b < a) {
+            fprintf(stderr, "Frames %s to %s are not in %s\n", argv[3],
+                    argv[4], argv[1]);
+            return 1;
+        }
+        first = a;
+        last = b;
+    }
+
+    ofstream out(argv[2]);
+    if (!out.is_open()) {
+        fprintf(stderr, "Failed to create %s\n", argv[2]);
+        return 1;
+    }
+
+    std::vector<Triangle> tris(reader.header().bodyCount);
+    TrajView frame;
+    unsigned int frames = 0;
+    for (unsigned int i = first; i <= last; i++) {
+        if (!reader.view(i, frame)) {
+            fprintf(stderr, "Frame %u is damaged, stopping\n",
+                    reader.frameNumber(i));
+            break;
+        }
+        for (unsigned int id = 0; id < tris.size(); id++) {
+            reader.vertices(frame, id, tris[id].verts);
+        }
+        printTimestep(frame.frame, &out, tris);
+        frames++;
+    }
+    out.close();
+
+    std::cout << "Bodies: " << tris.size() << " Frames: " << frames << " of "
+              << count << (reader.indexed() ? "" : ", unindexed") << "\n";
+    return 0;
+}